@@ -56,6 +56,13 @@ static char *open_failed = "could not open - odd file name?";
  */
 int expect_key = 0;
 
+/*
+ * exp_buffer_generation is the source for exp_f generations.  Drawing
+ * them all from one counter means a stale scan position can never be
+ * mistaken as belonging to a different spawn id's buffer.
+ */
+int exp_buffer_generation = 0;
+
 /*
  * The table is used to map channels to exp_f structures.
  */
@@ -73,6 +80,18 @@ static void		tcl_tracer _ANSI_ARGS_((ClientData clientData,
 static void		exp_i_add_f _ANSI_ARGS_((struct exp_i *,
 			    struct exp_f *fs));
 static void		exp_f_closed _ANSI_ARGS_((struct exp_f *));
+static int		exp_outq_write _ANSI_ARGS_((struct exp_f *));
+static void		exp_outq_handler _ANSI_ARGS_((ClientData clientData,
+			    int mask));
+static void		exp_outq_discard _ANSI_ARGS_((struct exp_f *));
+static void		exp_pace_add _ANSI_ARGS_((struct exp_f *, char *,
+			    int, int, int *));
+static int		exp_pace_wait _ANSI_ARGS_((struct exp_f *));
+static void		exp_pace_handler _ANSI_ARGS_((ClientData clientData));
+static int		exp_pace_discard _ANSI_ARGS_((struct exp_f *));
+static int		exp_f_alive _ANSI_ARGS_((struct exp_f *,
+			    unsigned long));
+static void		exp_log_free _ANSI_ARGS_((struct exp_log *));
 
 
 /*
@@ -205,6 +224,106 @@ exp_chan2f(interp,chan,opened,adjust,msg)
     return NULL;
 }
 
+/*
+ * Spawn ids passed as objects remember the exp_f they name, so that
+ * commands seeing the same object again (a spawn id held in a variable,
+ * or a literal in a compiled proc) need not look the id up again.
+ * exp_f_epoch changes whenever an exp_f is freed, which makes every
+ * remembered exp_f suspect.
+ */
+
+static unsigned long exp_f_epoch = 0;
+
+static void		DupSpawnIdInternalRep _ANSI_ARGS_((Tcl_Obj *srcPtr,
+			    Tcl_Obj *copyPtr));
+static int		SetSpawnIdFromAny _ANSI_ARGS_((Tcl_Interp *interp,
+			    Tcl_Obj *objPtr));
+
+static Tcl_ObjType exp_spawn_id_type = {
+    "spawnid",				/* name */
+    (Tcl_FreeInternalRepProc *) NULL,	/* freeIntRepProc */
+    DupSpawnIdInternalRep,		/* dupIntRepProc */
+    (Tcl_UpdateStringProc *) NULL,	/* updateStringProc: string rep */
+					/* is never invalidated */
+    SetSpawnIdFromAny			/* setFromAnyProc */
+};
+
+static void
+DupSpawnIdInternalRep(srcPtr, copyPtr)
+    Tcl_Obj *srcPtr;
+    Tcl_Obj *copyPtr;
+{
+    copyPtr->internalRep.twoPtrValue.ptr1 =
+	srcPtr->internalRep.twoPtrValue.ptr1;
+    copyPtr->internalRep.twoPtrValue.ptr2 =
+	srcPtr->internalRep.twoPtrValue.ptr2;
+    copyPtr->typePtr = &exp_spawn_id_type;
+}
+
+/*ARGSUSED*/
+static int
+SetSpawnIdFromAny(interp, objPtr)
+    Tcl_Interp *interp;
+    Tcl_Obj *objPtr;
+{
+    struct exp_f *f;
+
+    f = exp_f_find(interp, Tcl_GetStringFromObj(objPtr, (int *) NULL));
+    if (f == NULL) {
+	return TCL_ERROR;
+    }
+    if ((objPtr->typePtr != NULL)
+	    && (objPtr->typePtr->freeIntRepProc != NULL)) {
+	objPtr->typePtr->freeIntRepProc(objPtr);
+    }
+    objPtr->internalRep.twoPtrValue.ptr1 = (VOID *) f;
+    objPtr->internalRep.twoPtrValue.ptr2 = (VOID *) exp_f_epoch;
+    objPtr->typePtr = &exp_spawn_id_type;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_obj2f --
+ *
+ *	Like exp_chan2f, but for a spawn id held in an object.
+ *
+ * Results:
+ *	An exp_f structure if found and usable, NULL if not.
+ *
+ * Side Effects:
+ *	The exp_f is remembered in the object.
+ *
+ *----------------------------------------------------------------------
+ */
+
+struct exp_f *
+exp_obj2f(interp,objPtr,opened,adjust,msg)
+    Tcl_Interp *interp;
+    Tcl_Obj *objPtr;		/* Spawn id */
+    int opened;			/* check not closed */
+    int adjust;			/* adjust buffer sizes */
+    char *msg;
+{
+    struct exp_f *f;
+
+    if ((objPtr->typePtr == &exp_spawn_id_type
+	    && objPtr->internalRep.twoPtrValue.ptr2 == (VOID *) exp_f_epoch)
+	    || SetSpawnIdFromAny(interp, objPtr) == TCL_OK) {
+	f = (struct exp_f *) objPtr->internalRep.twoPtrValue.ptr1;
+	if ((!opened) || !f->user_closed) {
+	    if (adjust) {
+		exp_adjust(f);
+	    }
+	    return f;
+	}
+    }
+    exp_error(interp,"%s: invalid spawn id (%s)",msg,
+	      Tcl_GetStringFromObj(objPtr, (int *) NULL));
+    return NULL;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -331,13 +450,31 @@ exp_f_new(interp,chan,spawnId,pid)
     f->size = 0;
     f->msize = 0;
     f->buffer = 0;
+    f->lower = 0;
+    f->lower_valid = 0;
+    f->offset = 0;
+    f->cap = 0;
     f->printed = 0;
     f->echoed = 0;
     f->rm_nulls = exp_default_rm_nulls;
     f->parity = exp_default_parity;
     f->key = expect_key++;
     f->force_read = FALSE;
+    exp_buffer_changed(f);
     f->fg_armed = FALSE;
+    f->ready_mask = 0;
+    f->ready_next = NULL;
+    f->outq = 0;
+    f->outq_size = 0;
+    f->outq_msize = 0;
+    f->outq_hiwater = 0;
+    f->outq_cmd = 0;
+    f->outq_armed = FALSE;
+    f->pace_head = NULL;
+    f->pace_tail = NULL;
+    f->pace_timer = NULL;
+    memset((char *)&f->stats,0,sizeof(f->stats));
+    f->log = 0;
     f->umsize = exp_default_match_max;
     f->valid = TRUE;
     f->user_closed = FALSE;
@@ -389,7 +526,7 @@ exp_f_free(f)
     struct exp_f *f;
 {
     if (f->buffer) {
-	ckfree(f->buffer);
+	ckfree(f->buffer - f->offset);
 	f->buffer = 0;
 	f->msize = 0;
 	f->size = 0;
@@ -399,11 +536,23 @@ exp_f_free(f)
 	    exp_event_disarm(f);
 	    f->fg_armed = FALSE;
 	}
-	ckfree(f->lower);
+	if (f->lower) {
+	    ckfree(f->lower - f->offset);
+	    f->lower = 0;
+	}
+	f->offset = 0;
+	f->cap = 0;
     }
     ckfree(f->spawnId);
     f->fg_armed = FALSE;
+    exp_event_unqueue(f);
+    exp_pace_discard(f);
+    exp_outq_discard(f);
+    if (f->outq) ckfree(f->outq);
+    if (f->outq_cmd) ckfree(f->outq_cmd);
+    if (f->log) exp_log_free(f->log);
     Tcl_DeleteHashEntry(f->hashPtr);
+    exp_f_epoch++;
 
     exp_f_free_platform(f);
     ckfree((char *) f);
@@ -432,6 +581,13 @@ exp_f_closed(f)
     exp_configure_count++;
 
     f->fg_armed = FALSE;
+    exp_event_unqueue(f);
+    exp_pace_discard(f);
+    exp_outq_discard(f);
+    if (f->log) {
+	exp_log_free(f->log);
+	f->log = 0;
+    }
     f->valid = FALSE;
 
     if (f->user_waited) {
@@ -554,11 +710,26 @@ exp_update_master(interp,opened,adjust)
     int opened;
     int adjust;
 {
-    char *s = exp_get_var(interp,EXP_SPAWN_ID_VARNAME);
-    if (s == NULL) {
+    static Tcl_Obj *varName = NULL;
+    Tcl_Obj *objPtr;
+    char *s;
+
+    /* look up by object, so the exp_f is remembered in the value */
+    if (varName == NULL) {
+	varName = Tcl_NewStringObj(EXP_SPAWN_ID_VARNAME, -1);
+	Tcl_IncrRefCount(varName);
+    }
+    objPtr = Tcl_ObjGetVar2(interp, varName, (Tcl_Obj *) NULL, 0);
+    if (objPtr == NULL) {
+	objPtr = Tcl_ObjGetVar2(interp, varName, (Tcl_Obj *) NULL,
+				TCL_GLOBAL_ONLY);
+    }
+    if (objPtr == NULL) {
 	s = EXP_SPAWN_ID_USER;
+	return exp_chan2f(interp,s,opened,adjust,s);
     }
-    return exp_chan2f(interp,s,opened,adjust,s);
+    s = Tcl_GetStringFromObj(objPtr, (int *) NULL);
+    return exp_obj2f(interp,objPtr,opened,adjust,s);
 }
 
 /*
@@ -656,10 +827,12 @@ get_slow_args(interp,x)
  *	Write some bytes   s  l  o  w  l  y
  *
  * Results:
- *	0 on success, -1 on failure, positive for standard Tcl result
+ *	0 on success, -1 on failure
  *	
  * Side Effects:
- *	Data is written to an output object
+ *	Data is queued to be written to an output object by timer
+ *	handlers.  Unless nowait is set, events are processed until
+ *	it has all been written.
  *
  * Notes:
  *	OS independent
@@ -668,30 +841,26 @@ get_slow_args(interp,x)
  */
 
 static int
-slow_write(interp,f,buffer,rembytes,arg)
+slow_write(interp,f,buffer,rembytes,arg,nowait)
     Tcl_Interp *interp;
     struct exp_f *f;
     char *buffer;
     int rembytes;
     struct slow_arg *arg;
+    int nowait;
 {
-    int rc;
+    int delay = 0;		/* no sleep before first write */
 
     while (rembytes > 0) {
 	int len;
 
 	len = (arg->size<rembytes?arg->size:rembytes);
-	if (0 > exp_exact_write(f,buffer,len)) return(-1);
+	exp_pace_add(f,buffer,len,delay,(int *)0);
 	rembytes -= arg->size;
 	buffer += arg->size;
-
-	/* skip sleep after last write */
-	if (rembytes > 0) {
-	    rc = exp_dsleep(interp,arg->time);
-	    if (rc>0) return rc;
-	}
+	delay = (int)(arg->time*1000);
     }
-    return(0);
+    return(nowait?0:exp_pace_wait(f));
 }
 
 struct human_arg {
@@ -828,26 +997,26 @@ exp_init_unit_random()
  *	transitions.
  *
  * Results:
- *	0 for success, -1 for failure, positive for standard Tcl result
+ *	0 for success, -1 for failure
  *
  * Side Effects:
- *	None
+ *	As for slow_write
  *
  *----------------------------------------------------------------------
  */
 
 static int
-human_write(interp,f,buffer,arg)
+human_write(interp,f,buffer,arg,nowait)
     Tcl_Interp *interp;
     struct exp_f *f;
     char *buffer;
     struct human_arg *arg;
+    int nowait;
 {
     char *sp;
     float t;
     float alpha;
     int in_word = TRUE;
-    int wc;
 
     debuglog("human_write: avg_arr=%f/%f  1/shape=%f  min=%f  max=%f\r\n",
 	     arg->alpha,arg->alpha_eow,arg->c,arg->min,arg->max);
@@ -867,17 +1036,9 @@ human_write(interp,f,buffer,arg)
 
 	/*fprintf(stderr,"\nwriting <%c> but first sleep %f seconds\n",*sp,t);*/
 	/* skip sleep before writing first character */
-	if (sp != buffer) {
-	    wc = exp_dsleep(interp,(double)t);
-	    if (wc > 0) return wc;
-	}
-
-	wc = exp_exact_write(f, sp, 1);
-	if (wc == -1) {
-	    return -1;
-	}
+	exp_pace_add(f,sp,1,(sp == buffer)?0:(int)(t*1000),(int *)0);
     }
-    return(0);
+    return(nowait?0:exp_pace_wait(f));
 }
 
 struct exp_i *exp_i_pool = 0;
@@ -1304,6 +1465,14 @@ exp_exact_write(f,buffer,rembytes)
     int rembytes;
 {
     int n;
+
+    /* output queued by send -nowait goes first */
+    if (f->outq_size) {
+	n = f->outq_size;
+	exp_outq_discard(f);
+	if (0 > exp_exact_write(f,f->outq,n)) return -1;
+    }
+
     while (rembytes) {
 	n = Tcl_Write(f->channel, buffer, rembytes);
 	if (-1 == n) {
@@ -1312,6 +1481,9 @@ exp_exact_write(f,buffer,rembytes)
 	if (0 == n) {
 	    Tcl_Sleep(1000);
 	    exp_debuglog("write() failed to write anything but returned - sleeping and retrying...\n");
+	} else {
+	    f->stats.writes++;
+	    f->stats.write_bytes += n;
 	}
 	buffer += n;
 	rembytes -= n;
@@ -1322,227 +1494,642 @@ exp_exact_write(f,buffer,rembytes)
 /*
  *----------------------------------------------------------------------
  *
- * ExpSpawnOpen --
+ * exp_queue_write --
  *
- *	Handle the 'spawn -open' command.  Called from Exp_SpawnCmd.
+ *	Write bytes without waiting for the process to take them.
+ *	Whatever can't be written right away is queued on the exp_f
+ *	and written from a writable channel handler.
  *
  * Results:
- *	A standard Tcl result
+ *	0 on success, -1 on failure, positive for standard Tcl result
+ *	(from the high-water command)
+ *
+ * Side Effects:
+ *	Data is written to an output object, or queued.  If the queue
+ *	grows to its high-water mark, the send_queue -command script is
+ *	evaluated.
  *
  *----------------------------------------------------------------------
  */
 
 int
-ExpSpawnOpen(interp, chanId, leaveopen)
+exp_queue_write(interp,f,buffer,len)
     Tcl_Interp *interp;
-    char *chanId;
-    int leaveopen;
-{
-    Tcl_Channel chan;
-    int mode;
     struct exp_f *f;
-    
-    if (!(chan = Tcl_GetChannel(interp, chanId, &mode))) {
-	return TCL_ERROR;
-    }
-    if (!mode) {
-	exp_error(interp,"%s: channel is neither readable nor writable",
-		  chanId);
-	return TCL_ERROR;
+    char *buffer;
+    int len;
+{
+    int old_size = f->outq_size;
+
+    if (len <= 0) return 0;
+
+    if (f->outq_size + len > f->outq_msize) {
+	int msize = 2*f->outq_msize;
+	char *outq;
+
+	if (msize < f->outq_size + len) msize = f->outq_size + len;
+	if (msize < 1024) msize = 1024;
+	outq = ckalloc(msize);
+	if (f->outq_size) memcpy(outq,f->outq,f->outq_size);
+	if (f->outq) ckfree(f->outq);
+	f->outq = outq;
+	f->outq_msize = msize;
     }
+    memcpy(f->outq + f->outq_size,buffer,len);
+    f->outq_size += len;
 
-    f = exp_f_find(interp, chanId);
-    if (! f) {
-	f = exp_f_new(interp, chan, NULL, EXP_NOPID);
-	f->leaveopen = leaveopen;
+    /* if nothing was waiting, maybe it can all go now */
+    if (old_size == 0 && exp_outq_write(f) < 0) {
+	f->outq_size = 0;
+	return -1;
+    }
 
-	exp_wait_zero(&f->wait);
-    } else {
-	/*
-	 * Reference count this thing
-	 */
+    if (f->outq_size && !f->outq_armed) {
+	Tcl_CreateChannelHandler(f->channel,TCL_WRITABLE,
+				 exp_outq_handler,(ClientData)f);
+	f->outq_armed = TRUE;
+    }
 
-	f->leaveopen += leaveopen;
+    if (f->outq_cmd && f->outq_hiwater > 0
+	&& old_size < f->outq_hiwater && f->outq_size >= f->outq_hiwater) {
+	debuglog("send: %s has %d bytes queued\r\n",f->spawnId,f->outq_size);
+	return Tcl_GlobalEval(interp,f->outq_cmd);
     }
+    return 0;
+}
 
-    /* tell user id of new process */
-    Tcl_SetVar(interp,EXP_SPAWN_ID_VARNAME,chanId,0);
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_outq_write --
+ *
+ *	Write as much of the output queue as the channel will take
+ *	without blocking.  The channel driver is called directly since
+ *	the Tcl channel is unbuffered and usually blocking.  On NT
+ *	the spawn channel sits on a pipe that can only block when
+ *	written to, so there the whole queue is written each time.
+ *
+ * Results:
+ *	Number of bytes written, or -1 on failure
+ *
+ *----------------------------------------------------------------------
+ */
 
-    sprintf(interp->result,"%d",EXP_NOPID);
-    debuglog("spawn: returns {%s}\r\n",interp->result);
+static int
+exp_outq_write(f)
+    struct exp_f *f;
+{
+    Tcl_ChannelType *type = Tcl_GetChannelType(f->channel);
+    ClientData instanceData = Tcl_GetChannelInstanceData(f->channel);
+    int blocking = TRUE;
+    int n, errorCode = 0;
+    Tcl_DString ds;
 
-    return TCL_OK;
+    Tcl_DStringInit(&ds);
+    if (Tcl_GetChannelOption((Tcl_Interp *) NULL,f->channel,"-blocking",&ds)
+	== TCL_OK) {
+	blocking = (Tcl_DStringValue(&ds)[0] == '1');
+    }
+    Tcl_DStringFree(&ds);
+
+    if (blocking && type->blockModeProc) {
+	(type->blockModeProc)(instanceData,TCL_MODE_NONBLOCKING);
+    }
+    n = (type->outputProc)(instanceData,f->outq,f->outq_size,&errorCode);
+    if (blocking && type->blockModeProc) {
+	(type->blockModeProc)(instanceData,TCL_MODE_BLOCKING);
+    }
+
+    if (n < 0) {
+	if ((errorCode == EWOULDBLOCK) || (errorCode == EAGAIN)) return 0;
+	Tcl_SetErrno(errorCode);
+	return -1;
+    }
+    if (n > 0) {
+	f->stats.writes++;
+	f->stats.write_bytes += n;
+    }
+    f->outq_size -= n;
+    if (f->outq_size) memmove(f->outq,f->outq + n,f->outq_size);
+    return n;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Exp_SendLogCmd --
+ * exp_outq_handler --
  *
- *	Implements the send_log command.
+ *	Tcl calls this routine when a channel with queued output
+ *	can be written to.
  *
  * Results:
- *	A standard Tcl result
+ *	None
  *
  * Side Effects:
- *	Messages are written to a log file
+ *	Queued output is written.  If that fails, the rest is thrown
+ *	away and a background error is reported.
  *
  *----------------------------------------------------------------------
  */
 
-/*ARGSUSED*/
-static int
-Exp_SendLogCmd(clientData, interp, argc, argv)
+static void
+exp_outq_handler(clientData,mask)
     ClientData clientData;
-    Tcl_Interp *interp;
-    int argc;
-    char **argv;
+    int mask;
 {
-    char *string;
-    int len;
-
-    argv++;
-    argc--;
+    struct exp_f *f = (struct exp_f *) clientData;
 
-    if (argc) {
-	if (streq(*argv,"--")) {
-	    argc--; argv++;
-	}
+    if (exp_outq_write(f) < 0) {
+	exp_outq_discard(f);
+	exp_error(f->interp,"write(spawn_id=%s): %s",f->spawnId,
+		  Tcl_PosixError(f->interp));
+	Tcl_BackgroundError(f->interp);
+	return;
     }
+    if (f->outq_size == 0) exp_outq_discard(f);
+}
 
-    if (argc != 1) {
-	exp_error(interp,"usage: send [args] string");
-	return TCL_ERROR;
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_outq_discard --
+ *
+ *	Stop flushing the output queue, forgetting whatever is in it.
+ *	The storage is kept for reuse.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_outq_discard(f)
+    struct exp_f *f;
+{
+    if (f->outq_armed) {
+	Tcl_DeleteChannelHandler(f->channel,exp_outq_handler,(ClientData)f);
+	f->outq_armed = FALSE;
     }
+    f->outq_size = 0;
+}
 
-    string = *argv;
+/*
+ * send -s and send -h are broken into chunks.  Each is written by a
+ * timer handler its delay after the one before it, so the rest of the
+ * application keeps running while a paced send is in progress.
+ */
 
-    len = strlen(string);
+struct exp_pace {
+    struct exp_pace *next;
+    int delay;		/* ms to wait after the previous chunk */
+    int *status;	/* if set, 0 when written, else errno */
+    int len;
+    char *buf;		/* len chars, stored after this structure */
+};
 
-    if (debugfile) Tcl_Write(debugfile, string, len);
-    if (logfile) Tcl_Write(logfile, string, len);
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_pace_add --
+ *
+ *	Queue a chunk to be written after a delay
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	If no chunk was pending, a timer handler is started
+ *
+ *----------------------------------------------------------------------
+ */
 
-    return(TCL_OK);
+static void
+exp_pace_add(f,buffer,len,delay,status)
+    struct exp_f *f;
+    char *buffer;
+    int len;
+    int delay;
+    int *status;
+{
+    struct exp_pace *p;
+
+    p = (struct exp_pace *) ckalloc(sizeof(struct exp_pace) + len);
+    p->next = NULL;
+    p->delay = delay;
+    p->status = status;
+    p->len = len;
+    p->buf = (char *)(p + 1);
+    memcpy(p->buf,buffer,len);
+
+    if (f->pace_tail) {
+	f->pace_tail->next = p;
+    } else {
+	f->pace_head = p;
+	f->pace_timer = Tcl_CreateTimerHandler(delay,exp_pace_handler,
+					       (ClientData) f);
+    }
+    f->pace_tail = p;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Exp_SendCmd --
+ * exp_pace_wait --
  *
- *	Sends data to a subprocess or over some channel
+ *	Wait for everything queued by exp_pace_add to be written
  *
  * Results:
- *	Standard Tcl result
- *
- * Notes:
- *	(Don) I've rewritten this to be unbuffered.  I did this so you
- *	could shove large files through "send".  If you are concerned
- *	about efficiency, you should quote all your send args to make
- *	them one single argument.
+ *	0 on success, -1 on failure
  *
- *	(GCC) This uses Tcl channels.  By default, the channel
- *	translation will be binary for channels created with
- *	spawn <program>.  The clientData argument, if non-NULL,
- *	holds the name of the channel to use.
+ * Side Effects:
+ *	Events are processed.  The exp_f may be gone upon return.
  *
  *----------------------------------------------------------------------
  */
 
-/*ARGSUSED*/
 static int
-Exp_SendCmd(clientData, interp, argc, argv)
+exp_pace_wait(f)
+    struct exp_f *f;
+{
+    int status = -1;
+
+    if (!f->pace_head) return 0;
+
+    exp_pace_add(f,"",0,0,&status);
+    while (status == -1) {
+	Tcl_DoOneEvent(0);
+    }
+    if (status) {
+	Tcl_SetErrno(status);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_pace_handler --
+ *
+ *	Tcl calls this routine when it is time to write the next
+ *	chunk of a paced send.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	The chunk is written without blocking (see exp_queue_write) and
+ *	the timer for the following one is started.  If writing fails,
+ *	the rest is thrown away.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_pace_handler(clientData)
     ClientData clientData;
-    Tcl_Interp *interp;
-    int argc;
-    char **argv;
 {
-    int rc;			/* final result of this procedure */
-    struct human_arg human_args;
-    struct slow_arg slow_args;
-#define SEND_STYLE_STRING_MASK	0x07 /* mask to detect a real string arg */
-#define SEND_STYLE_PLAIN	0x01
-#define SEND_STYLE_HUMAN	0x02
+    struct exp_f *f = (struct exp_f *) clientData;
+    struct exp_pace *p = f->pace_head;
+    int rc;
+
+    f->pace_timer = NULL;
+    f->pace_head = p->next;
+    if (!f->pace_head) f->pace_tail = NULL;
+
+    rc = exp_queue_write(f->interp,f,p->buf,p->len);
+    if (rc == -1) {
+	int error = Tcl_GetErrno();
+	int waited = (p->status != NULL);
+
+	if (p->status) *p->status = error;
+	ckfree((char *) p);
+	if (!exp_pace_discard(f) && !waited) {
+	    exp_error(f->interp,"write(spawn_id=%s): %s",f->spawnId,
+		      Tcl_PosixError(f->interp));
+	    Tcl_BackgroundError(f->interp);
+	}
+	return;
+    }
+    if (p->status) *p->status = 0;
+    ckfree((char *) p);
+    if (rc > 0) Tcl_BackgroundError(f->interp);
+
+    if (f->pace_head) {
+	f->pace_timer = Tcl_CreateTimerHandler(f->pace_head->delay,
+					       exp_pace_handler,
+					       (ClientData) f);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_pace_discard --
+ *
+ *	Throw away any chunks of paced sends not yet written
+ *
+ * Results:
+ *	TRUE if someone was waiting for them (and will report it)
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+exp_pace_discard(f)
+    struct exp_f *f;
+{
+    struct exp_pace *p;
+    int waited = FALSE;
+
+    if (f->pace_timer) {
+	Tcl_DeleteTimerHandler(f->pace_timer);
+	f->pace_timer = NULL;
+    }
+    while ((p = f->pace_head) != NULL) {
+	f->pace_head = p->next;
+	if (p->status) {
+	    *p->status = EPIPE;
+	    waited = TRUE;
+	}
+	ckfree((char *) p);
+    }
+    f->pace_tail = NULL;
+    return waited;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_f_alive --
+ *
+ *	Tell whether an exp_f that existed when exp_f_epoch was epoch
+ *	has survived events processed since then.
+ *
+ * Results:
+ *	TRUE if f is still in the spawn id table
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+exp_f_alive(f,epoch)
+    struct exp_f *f;
+    unsigned long epoch;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (epoch == exp_f_epoch) return TRUE;
+
+    for (hPtr = Tcl_FirstHashEntry(exp_f_table, &search); hPtr != NULL;
+	 hPtr = Tcl_NextHashEntry(&search)) {
+	if ((struct exp_f *) Tcl_GetHashValue(hPtr) == f) return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpSpawnOpen --
+ *
+ *	Handle the 'spawn -open' command.  Called from Exp_SpawnCmd.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+ExpSpawnOpen(interp, chanId, leaveopen)
+    Tcl_Interp *interp;
+    char *chanId;
+    int leaveopen;
+{
+    Tcl_Channel chan;
+    int mode;
+    struct exp_f *f;
+    
+    if (!(chan = Tcl_GetChannel(interp, chanId, &mode))) {
+	return TCL_ERROR;
+    }
+    if (!mode) {
+	exp_error(interp,"%s: channel is neither readable nor writable",
+		  chanId);
+	return TCL_ERROR;
+    }
+
+    f = exp_f_find(interp, chanId);
+    if (! f) {
+	f = exp_f_new(interp, chan, NULL, EXP_NOPID);
+	f->leaveopen = leaveopen;
+
+	exp_wait_zero(&f->wait);
+    } else {
+	/*
+	 * Reference count this thing
+	 */
+
+	f->leaveopen += leaveopen;
+    }
+
+    /* tell user id of new process */
+    Tcl_SetVar(interp,EXP_SPAWN_ID_VARNAME,chanId,0);
+
+    sprintf(interp->result,"%d",EXP_NOPID);
+    debuglog("spawn: returns {%s}\r\n",interp->result);
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_SendLogCmd --
+ *
+ *	Implements the send_log command.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side Effects:
+ *	Messages are written to a log file
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static int
+Exp_SendLogCmd(clientData, interp, argc, argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    char **argv;
+{
+    char *string;
+    int len;
+
+    argv++;
+    argc--;
+
+    if (argc) {
+	if (streq(*argv,"--")) {
+	    argc--; argv++;
+	}
+    }
+
+    if (argc != 1) {
+	exp_error(interp,"usage: send [args] string");
+	return TCL_ERROR;
+    }
+
+    string = *argv;
+
+    len = strlen(string);
+
+    if (debugfile) Tcl_Write(debugfile, string, len);
+    exp_logfile_write(string, len);
+
+    return(TCL_OK);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_SendObjCmd --
+ *
+ *	Sends data to a subprocess or over some channel
+ *
+ * Results:
+ *	Standard Tcl result
+ *
+ * Notes:
+ *	(Don) I've rewritten this to be unbuffered.  I did this so you
+ *	could shove large files through "send".  If you are concerned
+ *	about efficiency, you should quote all your send args to make
+ *	them one single argument.
+ *
+ *	(GCC) This uses Tcl channels.  By default, the channel
+ *	translation will be binary for channels created with
+ *	spawn <program>.  The clientData argument, if non-NULL,
+ *	holds the name of the channel to use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static int
+Exp_SendObjCmd(clientData, interp, objc, objv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    int rc;			/* final result of this procedure */
+    struct human_arg human_args;
+    struct slow_arg slow_args;
+#define SEND_STYLE_STRING_MASK	0x07 /* mask to detect a real string arg */
+#define SEND_STYLE_PLAIN	0x01
+#define SEND_STYLE_HUMAN	0x02
 #define SEND_STYLE_SLOW		0x04
 #define SEND_STYLE_ZERO		0x10
 #define SEND_STYLE_BREAK	0x20
     int send_style = SEND_STYLE_PLAIN;
     int want_cooked = TRUE;
+    int nowait = FALSE;		/* queue what can't be written at once */
     char *string;		/* string to send */
     int len;			/* length of string to send */
     int zeros;			/* count of how many ascii zeros to send */
     
-    char *i_masters = 0;
+    Tcl_Obj *i_masters = 0;
     struct exp_fs_list *fs;
     struct exp_i *i;
     char *arg;
+    int index;
     struct exp_f *f = NULL;
-    char *argv0 = argv[0];
+    char *argv0 = Tcl_GetStringFromObj(objv[0], (int *) NULL);
+    unsigned long epoch;	/* exp_f_epoch before any events ran */
+    Tcl_DString id;		/* name of f, which may go away while */
+				/* a paced send is waited for */
+    static char *flags[] = {
+	"--", "-i", "-h", "-s", "-null", "-0", "-n", "-raw", "-nowait",
+	"-break", (char *) NULL
+    };
+    enum flags {
+	SEND_DASHDASH, SEND_I, SEND_H, SEND_S, SEND_NULL, SEND_0, SEND_N,
+	SEND_RAW, SEND_NOWAIT, SEND_BREAK
+    };
     
-    argv++;
-    argc--;
-    while (argc) {
-	arg = *argv;
+    objv++;
+    objc--;
+    while (objc) {
+	arg = Tcl_GetStringFromObj(*objv, (int *) NULL);
 	if (arg[0] != '-') break;
-	arg++;
-	if (exp_flageq1('-',arg)) { /* "--" */
-	    argc--; argv++;
+	if (Tcl_GetIndexFromObj((Tcl_Interp *) NULL, *objv, flags, "flag",
+				0, &index) != TCL_OK) {
+	    exp_error(interp,"usage: unrecognized flag <%.80s>",arg);
+	    return TCL_ERROR;
+	}
+	objc--; objv++;
+	switch ((enum flags) index) {
+	case SEND_DASHDASH:
 	    break;
-	} else if (exp_flageq1('i',arg)) { /* "-i" */
-	    argc--; argv++;
-	    if (argc==0) {
+	case SEND_I:
+	    if (objc==0) {
 		exp_error(interp,"usage: %s -i spawn_id", argv0);
 		return(TCL_ERROR);
 	    }
-	    i_masters = *argv;
-	    argc--; argv++;
+	    i_masters = *objv;
+	    objc--; objv++;
 	    continue;
-	} else if (exp_flageq1('h',arg)) { /* "-h" */
-	    argc--; argv++;
+	case SEND_H:
 	    if (-1 == get_human_args(interp,&human_args))
 		return(TCL_ERROR);
 	    send_style = SEND_STYLE_HUMAN;
 	    continue;
-	} else if (exp_flageq1('s',arg)) { /* "-s" */
-	    argc--; argv++;
+	case SEND_S:
 	    if (-1 == get_slow_args(interp,&slow_args))
 		return(TCL_ERROR);
 	    send_style = SEND_STYLE_SLOW;
 	    continue;
-	} else if (exp_flageq("null",arg,1) || exp_flageq1('0',arg)) {
-	    argc--; argv++;	/* "-null" */
-	    if (!*argv) zeros = 1;
+	case SEND_NULL:
+	case SEND_0:
+	case SEND_N:
+	    if (objc==0) zeros = 1;
 	    else {
-		zeros = atoi(*argv);
-		argc--; argv++;
+		zeros = atoi(Tcl_GetStringFromObj(*objv, (int *) NULL));
+		objc--; objv++;
 		if (zeros < 1) return TCL_OK;
 	    }
 	    send_style = SEND_STYLE_ZERO;
 	    string = "<zero(s)>";
 	    continue;
-	} else if (exp_flageq("raw",arg,1)) { /* "-raw" */
-	    argc--; argv++;
+	case SEND_RAW:
 	    want_cooked = FALSE;
 	    continue;
-	} else if (exp_flageq("break",arg,1)) {	/* "-break" */
-	    argc--; argv++;
+	case SEND_NOWAIT:
+	    nowait = TRUE;
+	    continue;
+	case SEND_BREAK:
 	    send_style = SEND_STYLE_BREAK;
 	    string = "<break>";
 	    continue;
-	} else {
-	    exp_error(interp,"usage: unrecognized flag <-%.80s>",arg);
-	    return TCL_ERROR;
 	}
+	break;			/* "--" */
     }
     
     if (send_style & SEND_STYLE_STRING_MASK) {
-	if (argc != 1) {
+	if (objc != 1) {
 	    exp_error(interp,"usage: %s [args] string", argv0);
 	    return TCL_ERROR;
 	}
-	string = *argv;
+	string = Tcl_GetStringFromObj(*objv, &len);
+    } else {
+	len = strlen(string);
     }
-    len = strlen(string);
     
     if (clientData != NULL) {
 	f = exp_chan2f(interp, (char *) clientData, 1, 0, argv0);
@@ -1556,6 +2143,12 @@ Exp_SendCmd(clientData, interp, argc, argv)
 	if (f == NULL) {
 	    return(TCL_ERROR);
 	}
+    } else {
+	/* a single spawn id needs no exp_i of its own */
+	f = exp_obj2f(interp,i_masters,1,0,argv0);
+	if (f == NULL) {
+	    Tcl_ResetResult(interp);
+	}
     }
     
     /*
@@ -1565,8 +2158,9 @@ Exp_SendCmd(clientData, interp, argc, argv)
     if (f) {
 	i = exp_new_i_simple(f,EXP_TEMPORARY);
     } else {
-	i = exp_new_i_complex(interp,i_masters,FALSE,
-			      (Tcl_VarTraceProc *)NULL,argv0);
+	i = exp_new_i_complex(interp,
+			      Tcl_GetStringFromObj(i_masters, (int *) NULL),
+			      FALSE,(Tcl_VarTraceProc *)NULL,argv0);
 	if (i == NULL) {
 	    return TCL_ERROR;
 	}
@@ -1575,7 +2169,11 @@ Exp_SendCmd(clientData, interp, argc, argv)
     if (clientData == NULL) {
 	/* This seems to be the standard send call (send_to_proc) */
 	want_cooked = FALSE;
-	debuglog("send: sending \"%s\" to {",dprintify(string));
+	if (EXP_DEBUGGING) {
+	    debuglog("send: sending \"");
+	    exp_debuglog_printify(string,len);
+	    debuglog("\" to {");
+	}
 	/* if closing brace doesn't appear, that's because an error */
 	/* was encountered before we could send it */
     } else {
@@ -1587,15 +2185,28 @@ Exp_SendCmd(clientData, interp, argc, argv)
 	      strcmp((char *) clientData, exp_dev_tty_id) == 0 ||
 	      strcmp((char *) clientData, "exp_tty") == 0) && logfile_all) ||
 	    logfile) {
-	    if (logfile) {
-		Tcl_Write(logfile, string, len);
-	    }
+	    exp_logfile_write(string, len);
 	}
     }
     
+    /*
+     * Waiting for a paced send processes events, and they may close
+     * and free any of the spawn ids.  Only f's name is used after a
+     * wait, and the others are checked before they are used.
+     */
+    Tcl_DStringInit(&id);
+    epoch = exp_f_epoch;
     for (fs=i->fs_list;fs;fs=fs->next) {
 	f = fs->f;
 
+	if (!exp_f_alive(f,epoch)) {
+	    exp_error(interp,"send: spawn id closed while sending");
+	    rc = TCL_ERROR;
+	    goto finish;
+	}
+	Tcl_DStringSetLength(&id,0);
+	Tcl_DStringAppend(&id,f->spawnId,-1);
+
 	if (clientData == NULL) {
 	    /* send_to_proc */
 	    debuglog(" %s ", f->spawnId);
@@ -1609,19 +2220,37 @@ Exp_SendCmd(clientData, interp, argc, argv)
 
 	if (want_cooked) string = exp_cook(string,&len);
 
+	/* stay behind a paced send still in progress */
+	if (f->pace_head && !nowait
+	    && (send_style & (SEND_STYLE_PLAIN|SEND_STYLE_ZERO))) {
+	    if (0 > exp_pace_wait(f)) {
+		rc = -1;
+		goto write_failed;
+	    }
+	}
+
 	switch (send_style) {
 	case SEND_STYLE_PLAIN:
-	    rc = exp_exact_write(f,string,len);
+	    if (f->pace_head) {
+		exp_pace_add(f,string,len,0,(int *)0);
+		rc = 0;
+	    } else if (nowait) rc = exp_queue_write(interp,f,string,len);
+	    else rc = exp_exact_write(f,string,len);
 	    break;
 	case SEND_STYLE_SLOW:
-	    rc = slow_write(interp,f,string,len,&slow_args);
+	    rc = slow_write(interp,f,string,len,&slow_args,nowait);
 	    break;
 	case SEND_STYLE_HUMAN:
-	    rc = human_write(interp,f,string,&human_args);
+	    rc = human_write(interp,f,string,&human_args,nowait);
 	    break;
 	case SEND_STYLE_ZERO:
-	    for (;zeros>0;zeros--)
-		rc = exp_exact_write(f, "", 1);
+	    for (;zeros>0;zeros--) {
+		if (f->pace_head) {
+		    exp_pace_add(f,"",1,0,(int *)0);
+		    rc = 0;
+		} else if (nowait) rc = exp_queue_write(interp,f,"",1);
+		else rc = exp_exact_write(f, "", 1);
+	    }
 	    /* catching error on last write is sufficient */
 	    break;
 	case SEND_STYLE_BREAK:
@@ -1631,9 +2260,10 @@ Exp_SendCmd(clientData, interp, argc, argv)
 	}
 
 	if (rc != 0) {
+	write_failed:
 	    if (rc == -1) {
-		exp_error(interp,"write(spawn_id=%s): %s", f->spawnId,
-			  Tcl_PosixError(interp));
+		exp_error(interp,"write(spawn_id=%s): %s",
+			  Tcl_DStringValue(&id),Tcl_PosixError(interp));
 		rc = TCL_ERROR;
 	    }
 	    goto finish;
@@ -1646,10 +2276,295 @@ Exp_SendCmd(clientData, interp, argc, argv)
     
     rc = TCL_OK;
  finish:
+    Tcl_DStringFree(&id);
     exp_free_i(interp,i,(Tcl_VarTraceProc *)0);
     return rc;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_SendQueueCmd --
+ *
+ *	Implements the "send_queue" command.  Reports how much output
+ *	send -nowait has queued for a spawn id, and sets the high-water
+ *	mark and the command to evaluate when the queue reaches it.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side Effects:
+ *	None
+ *
+ * Notes:
+ *	OS independent
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static int
+Exp_SendQueueCmd(clientData,interp,argc,argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    char **argv;
+{
+    struct exp_f *f;
+    char *chanId = NULL;
+    char *argv0 = argv[0];
+    char *hiwater = NULL;
+    char *cmd = NULL;
+    int n;
+    
+    argc--; argv++;
+    
+    for (;argc>0;argc--,argv++) {
+	if (streq(*argv,"-i")) {
+	    argc--; argv++;
+	    if (!*argv) goto usage;
+	    chanId = *argv;
+	} else if (streq(*argv,"-hiwater")) {
+	    argc--; argv++;
+	    if (!*argv) goto usage;
+	    hiwater = *argv;
+	} else if (streq(*argv,"-command")) {
+	    argc--; argv++;
+	    if (!*argv) goto usage;
+	    cmd = *argv;
+	} else goto usage;
+    }
+    
+    if (chanId == NULL) {
+	f = exp_update_master(interp,0,0);
+    } else {
+	f = exp_chan2f(interp, chanId, 1, 0, argv0);
+    }
+    if (f == NULL) {
+	return(TCL_ERROR);
+    }
+
+    if (hiwater) {
+	if (Tcl_GetInt(interp,hiwater,&n) != TCL_OK) return TCL_ERROR;
+	f->outq_hiwater = n;
+    }
+    if (cmd) {
+	if (f->outq_cmd) ckfree(f->outq_cmd);
+	f->outq_cmd = 0;
+	if (*cmd) {
+	    f->outq_cmd = ckalloc(strlen(cmd) + 1);
+	    strcpy(f->outq_cmd,cmd);
+	}
+    }
+
+    sprintf(interp->result,"%d",f->outq_size);
+    return TCL_OK;
+ usage:
+    exp_error(interp,"usage: -i spawn_id -hiwater bytes -command script");
+    return TCL_ERROR;
+}
+
+static struct exp_log global_log;	/* the log in logfile */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_log_flush_handler --
+ *
+ *	Timer handler that flushes a buffered log some time after
+ *	output was written to it, so that it is never far behind.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_log_flush_handler(clientData)
+    ClientData clientData;
+{
+    struct exp_log *log = (struct exp_log *) clientData;
+
+    log->flush_timer = NULL;
+    if (log->chan) Tcl_Flush(log->chan);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_log_setup --
+ *
+ *	Give a newly opened log channel the buffering asked for, and
+ *	start counting towards its rotation.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_log_setup(log)
+    struct exp_log *log;
+{
+    char size[20];		/* enough for a %d */
+
+    if (log->bufsize) {
+	sprintf(size,"%d",log->bufsize);
+	Tcl_SetChannelOption((Tcl_Interp *) NULL,log->chan,"-buffersize",size);
+	Tcl_SetChannelOption((Tcl_Interp *) NULL,log->chan,"-buffering","full");
+    } else {
+	Tcl_SetChannelOption((Tcl_Interp *) NULL,log->chan,"-buffering","none");
+    }
+    log->written = 0;
+    log->opened = (long) time((time_t *) 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_log_rotate --
+ *
+ *	Begin a new log file.  filename.N becomes filename.N+1 for N
+ *	less than keep, filename becomes filename.1, and filename is
+ *	opened anew.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Files are renamed.  If filename can't be reopened, logging to
+ *	it stops.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_log_rotate(log)
+    struct exp_log *log;
+{
+    Tcl_DString from, to;
+    char suffix[20];		/* enough for a .%d */
+    int i;
+
+    if (log->flush_timer) {
+	Tcl_DeleteTimerHandler(log->flush_timer);
+	log->flush_timer = NULL;
+    }
+    Tcl_Close((Tcl_Interp *) NULL,log->chan);
+
+    Tcl_DStringInit(&from);
+    Tcl_DStringInit(&to);
+    for (i=log->keep;i>0;i--) {
+	Tcl_DStringTrunc(&to,0);
+	Tcl_DStringAppend(&to,log->filename,-1);
+	sprintf(suffix,".%d",i);
+	Tcl_DStringAppend(&to,suffix,-1);
+
+	Tcl_DStringTrunc(&from,0);
+	Tcl_DStringAppend(&from,log->filename,-1);
+	if (i > 1) {
+	    sprintf(suffix,".%d",i-1);
+	    Tcl_DStringAppend(&from,suffix,-1);
+	}
+
+	/* rename won't replace a file everywhere */
+	remove(Tcl_DStringValue(&to));
+	rename(Tcl_DStringValue(&from),Tcl_DStringValue(&to));
+    }
+    Tcl_DStringFree(&from);
+    Tcl_DStringFree(&to);
+
+    log->chan = Tcl_OpenFileChannel((Tcl_Interp *) NULL,log->filename,"w",0666);
+    if (log->chan) {
+	exp_log_setup(log);
+    } else {
+	debuglog("log_file: cannot reopen %s after rotating it\r\n",
+		 log->filename);
+    }
+    if (log == &global_log) {
+	logfile = log->chan;
+	if (!logfile) logfile_all = FALSE;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_log_write --
+ *
+ *	Write to a log, rotating it first if it is due.  If the log
+ *	is buffered, arrange for it to be flushed soon.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Output is written or buffered; a new log file may be begun.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_log_write(log,buf,len)
+    struct exp_log *log;
+    char *buf;
+    int len;
+{
+    if (!log->chan || len <= 0) return;
+
+    if ((log->rotate_size && log->written
+	 && (log->written + len > log->rotate_size))
+	|| (log->rotate_secs
+	    && ((long) time((time_t *) 0) - log->opened >= log->rotate_secs))) {
+	if (log->filename) {
+	    exp_log_rotate(log);
+	    if (!log->chan) return;
+	}
+    }
+
+    Tcl_Write(log->chan,buf,len);
+    log->written += len;
+
+    if (log->bufsize && log->flush_ms && !log->flush_timer) {
+	log->flush_timer = Tcl_CreateTimerHandler(log->flush_ms,
+		exp_log_flush_handler,(ClientData) log);
+    }
+}
+
+/* write to the log opened by log_file without -i */
+void
+exp_logfile_write(buf,len)
+    char *buf;
+    int len;
+{
+    exp_log_write(&global_log,buf,len);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_log_free --
+ *
+ *	Close a spawn id's own log and free it.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_log_free(log)
+    struct exp_log *log;
+{
+    if (log->flush_timer) Tcl_DeleteTimerHandler(log->flush_timer);
+    if (log->chan) Tcl_Close((Tcl_Interp *) NULL,log->chan);
+    ckfree(log->filename);
+    ckfree((char *) log);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1663,7 +2578,7 @@ Exp_SendCmd(clientData, interp, argc, argv)
  *
  * Side Effects:
  *	A file may be opened, or a currently open file may be
- *	changed to unbuffered
+ *	changed to unbuffered (or buffered, if -buffer is given)
  *
  *----------------------------------------------------------------------
  */
@@ -1689,12 +2604,20 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
     
     int aflag = FALSE;
     int append = TRUE;
+    int info = FALSE;
     char *filename = 0;
+    char *chan = 0;		/* spawn id from -i */
+    struct exp_log opts;	/* settings for the new log */
+    int n;
     char *type;
     int usage_error_occurred = FALSE;
     
     openarg = 0;
     leaveopen = FALSE;
+
+    memset((char *)&opts,0,sizeof(opts));
+    opts.flush_ms = 1000;
+    opts.keep = 1;
     
     if (first_time) {
 	Tcl_DStringInit(&dstring);
@@ -1723,14 +2646,38 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
 	} else if (streq(*argv,"-a")) {
 	    aflag = TRUE;
 	} else if (streq(*argv,"-info")) {
-	    if (logfile) {
-		if (logfile_all) strcat(interp->result,"-a ");
-		if (!current_append) strcat(interp->result,"-noappend ");
-		strcat(interp->result,Tcl_DStringValue(&dstring));
-	    }
-	    return TCL_OK;
+	    info = TRUE;
 	} else if (streq(*argv,"-noappend")) {
 	    append = FALSE;
+	} else if (streq(*argv,"-i")) {
+	    if (!argv[1]) usage_error;
+	    chan = argv[1];
+	    argc--; argv++;
+	} else if (streq(*argv,"-buffer") || streq(*argv,"-flush")
+		   || streq(*argv,"-rotate") || streq(*argv,"-rotate_time")
+		   || streq(*argv,"-keep")) {
+	    if (!argv[1]) usage_error;
+	    if (TCL_OK != Tcl_GetInt(interp,argv[1],&n)) goto error;
+	    if (n < 0) {
+		exp_error(interp,"%s: must not be negative",*argv);
+		goto error;
+	    }
+	    switch ((*argv)[1]) {
+	    case 'b':
+		if (n && (n < 10 || n > 1024*1024)) {
+		    exp_error(interp,"-buffer: must be 0 or from 10 to 1048576");
+		    goto error;
+		}
+		opts.bufsize = n;
+		break;
+	    case 'f': opts.flush_ms = n; break;
+	    case 'k': opts.keep = n; break;
+	    default:
+		if ((*argv)[7]) opts.rotate_secs = n;
+		else opts.rotate_size = n;
+		break;
+	    }
+	    argc--; argv++;
 	} else break;
     }
     
@@ -1747,6 +2694,55 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
     if (aflag && !(openarg || filename)) {
 	usage_error
     }
+    if ((opts.rotate_size || opts.rotate_secs) && !filename && !info) {
+	/* only a log opened by name can be reopened */
+	usage_error
+    }
+
+    if (chan) {
+	/* a spawn id's own log */
+	struct exp_f *f;
+	struct exp_log *log;
+
+	if (openarg || aflag) usage_error;
+	if (!(f = exp_chan2f(interp,chan,1,0,"log_file"))) goto error;
+
+	if (info) {
+	    if (f->log) Tcl_SetResult(interp,f->log->filename,TCL_VOLATILE);
+	    return TCL_OK;
+	}
+	if (f->log) {
+	    exp_log_free(f->log);
+	    f->log = 0;
+	}
+	if (!filename) return TCL_OK;
+
+	log = (struct exp_log *) ckalloc(sizeof(struct exp_log));
+	*log = opts;
+	log->chan = Tcl_OpenFileChannel(interp,filename,(append?"a":"w"),0666);
+	if (!log->chan) {
+	    ckfree((char *) log);
+	    exp_error(interp,"%s: %s",filename,Tcl_PosixError(interp));
+	    goto error;
+	}
+	log->filename = ckalloc(strlen(filename)+1);
+	strcpy(log->filename,filename);
+	exp_log_setup(log);
+	f->log = log;
+	return TCL_OK;
+    }
+
+    if (info) {
+	if (openarg) ckfree(openarg);
+	openarg = old_openarg;
+	leaveopen = old_leaveopen;
+	if (logfile) {
+	    if (logfile_all) strcat(interp->result,"-a ");
+	    if (!current_append) strcat(interp->result,"-noappend ");
+	    strcat(interp->result,Tcl_DStringValue(&dstring));
+	}
+	return TCL_OK;
+    }
     
     logfile = 0;
     logfile_all = aflag;
@@ -1761,6 +2757,8 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
 	    exp_error(interp,"%s: %s",filename,Tcl_PosixError(interp));
 	    goto error;
 	}
+	Tcl_DStringTrunc(&dstring,0);
+	Tcl_DStringAppend(&dstring,filename,-1);
     } else if (openarg) {
 	int mode;
 	
@@ -1788,8 +2786,18 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
 	 * do so later in our own close routine.
 	 */
     }
+
+    /* the old log's settings go with it */
+    if (global_log.flush_timer) Tcl_DeleteTimerHandler(global_log.flush_timer);
+    if (global_log.filename) ckfree(global_log.filename);
+    global_log = opts;
+    global_log.chan = logfile;
     if (logfile) {
-	Tcl_SetChannelOption(interp, logfile, "-buffering", "none");
+	if (filename) {
+	    global_log.filename = ckalloc(strlen(filename)+1);
+	    strcpy(global_log.filename,filename);
+	}
+	exp_log_setup(&global_log);
     }
     
     if (old_logfile) {
@@ -1814,7 +2822,7 @@ Exp_LogFileCmd(clientData, interp, argc, argv)
     leaveopen = old_leaveopen;
     
     if (usage_error_occurred) {
-	exp_error(interp,"usage: log_file [-info] [-noappend] [[-a] file] [-[leave]open [open ...]]");
+	exp_error(interp,"usage: log_file [-info] [-noappend] [-buffer bytes] [-flush ms] [-rotate bytes] [-rotate_time secs] [-keep n] [-i spawn_id] [[-a] file] [-[leave]open [open ...]]");
     }
     
     return TCL_ERROR;
@@ -2052,7 +3060,7 @@ Exp_ExitCmd(clientData, interp, argc, argv)
 /*
  *----------------------------------------------------------------------
  *
- * Exp_CloseCmd --
+ * Exp_CloseObjCmd --
  *
  *	Currently closes a channel or sets up handlers for
  *	when the channel closes.
@@ -2065,80 +3073,79 @@ Exp_ExitCmd(clientData, interp, argc, argv)
 
 /*ARGSUSED*/
 static int
-Exp_CloseCmd(clientData, interp, argc, argv)
+Exp_CloseObjCmd(clientData, interp, objc, objv)
     ClientData clientData;
     Tcl_Interp *interp;
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
 {
     char *close_onexec = NULL;
     int slave_flag = FALSE;
-    char *argv0 = argv[0];
+    char *argv0 = Tcl_GetStringFromObj(objv[0], (int *) NULL);
     struct exp_f *f;
 #if 0
     int slave;
 #endif
-    char *chanId = NULL;
-
-    int argc_orig = argc;
-    char **argv_orig = argv;
-
-    argc--; argv++;
-
-    for (;argc>0;argc--,argv++) {
-	if (streq(*argv,"-i")) {
-	    argc--; argv++;
-	    if (!*argv) {
+    Tcl_Obj *chanId = NULL;
+    int i, index;
+    static char *flags[] = {"-i", "-slave", "-onexec", (char *) NULL};
+    enum flags {CLOSE_I, CLOSE_SLAVE, CLOSE_ONEXEC};
+
+    for (i = 1;i<objc;i++) {
+	if (Tcl_GetIndexFromObj((Tcl_Interp *) NULL, objv[i], flags, "flag",
+				TCL_EXACT, &index) != TCL_OK) {
+	    break;
+	}
+	switch ((enum flags) index) {
+	case CLOSE_I:
+	    if (++i == objc) {
 		exp_error(interp,"usage: -i spawn_id");
 		return(TCL_ERROR);
 	    }
-	    chanId = *argv;
-	} else if (streq(*argv,"-slave")) {
+	    chanId = objv[i];
+	    break;
+	case CLOSE_SLAVE:
 	    slave_flag = TRUE;
-	} else if (streq(*argv,"-onexec")) {
-	    argc--; argv++;
-	    if (!*argv) {
+	    break;
+	case CLOSE_ONEXEC:
+	    if (++i == objc) {
 		exp_error(interp,"usage: -onexec channelId");
 		return(TCL_ERROR);
 	    }
-	    close_onexec = *argv;
-	} else break;
+	    close_onexec = Tcl_GetStringFromObj(objv[i], (int *) NULL);
+	    break;
+	}
     }
 
-    if (argc) {
+    if (i < objc) {
 	/* doesn't look like our format, it must be a Tcl-style file */
 	/* handle.  Lucky that formats are easily distinguishable. */
 	/* Historical note: we used "close"  long before there was a */
 	/* Tcl builtin by the same name. */
 
-	Tcl_Obj **objv;
-	int i, result;
+	Tcl_Obj **args = (Tcl_Obj **) objv + i - 1;
+	Tcl_Obj *arg = args[0];
 	Tcl_CmdInfo info;
+	int result;
 
 	Tcl_ResetResult(interp);
-	objv = (Tcl_Obj **) ckalloc((argc+1)*sizeof(Tcl_Obj *));
-	objv[0] = Tcl_NewStringObj("exp_tcl_close", -1);
-	for (i = 0; i < argc; i++) {
-	    objv[i+1] = Tcl_NewStringObj(argv[i], -1);
-	}
-
 	if (0 == Tcl_GetCommandInfo(interp,"exp_tcl_close",&info)) {
 	    info.clientData = 0;
 	}
-	result = info.objProc(info.objClientData,interp,argc+1,objv);
-	for (i = 0; i < argc+1; i++) {
-	    Tcl_DecrRefCount(objv[i]);
-	}
-	ckfree((char *) objv);
+	/* hand it the args from the first one we didn't understand, */
+	/* with our name in front */
+	args[0] = objv[0];
+	result = info.objProc(info.objClientData,interp,objc-i+1,args);
+	args[0] = arg;
 	return result;
     }
 
     if (chanId == NULL) {
 	f = exp_update_master(interp, 1, 0);
     } else if (slave_flag) {
-	f = exp_chan2f(interp, chanId, 1, 0, "-slave");
+	f = exp_obj2f(interp, chanId, 1, 0, "-slave");
     } else {
-	f = exp_chan2f(interp, chanId, 1, 0, argv0);
+	f = exp_obj2f(interp, chanId, 1, 0, argv0);
     }
     if (f == NULL) {
 	return TCL_ERROR;
@@ -2224,7 +3231,7 @@ Exp_StraceCmd(clientData, interp, argc, argv)
 /*
  *----------------------------------------------------------------------
  *
- * Exp_WaitCmd --
+ * Exp_WaitObjCmd --
  *
  *	Implements the 'wait' and 'exp_wait' commands.  When a process
  *	has been spawned, the wait call must be made before it will
@@ -2243,11 +3250,11 @@ Exp_StraceCmd(clientData, interp, argc, argv)
 
 /*ARGSUSED*/
 static int
-Exp_WaitCmd(clientData, interp, argc, argv)
+Exp_WaitObjCmd(clientData, interp, objc, objv)
     ClientData clientData;
     Tcl_Interp *interp;
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
 {
     int master_supplied = FALSE;
     struct exp_f *f;	/* ditto */
@@ -2261,35 +3268,43 @@ Exp_WaitCmd(clientData, interp, argc, argv)
     
     int nowait = FALSE;
     int nohang = FALSE;
-    char *chanId = NULL;
-    char *argv0 = argv[0];
+    Tcl_Obj *chanId = NULL;
+    char *argv0 = Tcl_GetStringFromObj(objv[0], (int *) NULL);
     Tcl_Pid result = 0;		/* 0 means child was successfully waited on */
+    int i, index;
+    static char *flags[] = {"-i", "-nowait", "-nohang", (char *) NULL};
+    enum flags {WAIT_I, WAIT_NOWAIT, WAIT_NOHANG};
 
     /* -1 means an error occurred */
     /* -2 means no eligible children to wait on */
 #define NO_CHILD ((Tcl_Pid) -2)
     
-    argv++;
-    argc--;
-    for (;argc>0;argc--,argv++) {
-	if (streq(*argv,"-i")) {
-	    argc--; argv++;
-	    if (argc==0) {
+    for (i = 1;i<objc;i++) {
+	if (Tcl_GetIndexFromObj((Tcl_Interp *) NULL, objv[i], flags, "flag",
+				TCL_EXACT, &index) != TCL_OK) {
+	    continue;
+	}
+	switch ((enum flags) index) {
+	case WAIT_I:
+	    if (++i == objc) {
 		exp_error(interp,"usage: -i spawn_id");
 		return(TCL_ERROR);
 	    }
-	    chanId = *argv;
-	} else if (streq(*argv,"-nowait")) {
+	    chanId = objv[i];
+	    break;
+	case WAIT_NOWAIT:
 	    nowait = TRUE;
-	} else if (streq(*argv,"-nohang")) {
+	    break;
+	case WAIT_NOHANG:
 	    nohang = TRUE;
+	    break;
 	}
     }
     
     if (chanId == NULL) {
 	f = exp_update_master(interp, 0, 0);
     } else {
-	f = exp_chan2f(interp, chanId, 0, 0, argv0);
+	f = exp_obj2f(interp, chanId, 0, 0, argv0);
     }
     if (f == NULL) {
 	return TCL_ERROR;
@@ -2647,6 +3662,21 @@ int minlen;		/* at least this many chars must match */
 	return 0;
 }
 
+static void
+exp_create_command(interp,name,c)
+    Tcl_Interp *interp;
+    char *name;
+    struct exp_cmd_data *c;
+{
+    if (c->objproc) {
+	Tcl_CreateObjCommand(interp,name,c->objproc,
+			     c->data, (Tcl_CmdDeleteProc *) NULL);
+    } else {
+	Tcl_CreateCommand(interp,name,c->proc,
+			  c->data, (Tcl_CmdDeleteProc *) NULL);
+    }
+}
+
 void
 exp_create_commands(interp,c)
     Tcl_Interp *interp;
@@ -2665,8 +3695,7 @@ exp_create_commands(interp,c)
 	if (create) {
 	    sprintf(cmdnamebuf, "rename %s exp_tcl_%s", c->name, c->name);
 	    Tcl_GlobalEval(interp, cmdnamebuf);
-	    Tcl_CreateCommand(interp,c->name,c->proc,
-			      c->data, (Tcl_CmdDeleteProc *) NULL);
+	    exp_create_command(interp,c->name,c);
 	}
 	if (!(c->name[0] == 'e' &&
 	      c->name[1] == 'x' &&
@@ -2674,14 +3703,13 @@ exp_create_commands(interp,c)
 	    && !(c->flags & EXP_NOPREFIX))
 	{
 	    sprintf(cmdnamebuf,"exp_%s",c->name);
-	    Tcl_CreateCommand(interp,cmdnamebuf,c->proc,
-			      c->data, (Tcl_CmdDeleteProc *) NULL);
+	    exp_create_command(interp,cmdnamebuf,c);
 	}
     }
 }
 
 static struct exp_cmd_data cmd_data[]  = {
-{"close",	Exp_CloseCmd,	0,	EXP_REDEFINE},
+{"close",	0,	0,	EXP_REDEFINE,	Exp_CloseObjCmd},
 #ifdef TCL_DEBUGGER
 {"debug",	Exp_DebugCmd,	0,	0},
 #endif
@@ -2706,16 +3734,21 @@ static struct exp_cmd_data cmd_data[]  = {
 {"overlay",	Exp_OverlayCmd,	0,	0},
 #endif
 {"inter_return",Exp_InterReturnCmd,	0,	0},
-{"send",	Exp_SendCmd,	(ClientData)NULL,	0},
-{"send_spawn",	Exp_SendCmd,	(ClientData)NULL,	0},/*deprecat*/
-{"send_error",	Exp_SendCmd,	(ClientData)"stderr",	0},
+{"send",	0,	(ClientData)NULL,	0,	Exp_SendObjCmd},
+{"send_spawn",	0,	(ClientData)NULL,	0,	Exp_SendObjCmd},/*deprecat*/
+{"send_error",	0,	(ClientData)"stderr",	0,	Exp_SendObjCmd},
 {"send_log",	Exp_SendLogCmd,	0,	0},
-{"send_tty",	Exp_SendCmd,	(ClientData)"exp_tty",	0},
-{"send_user",	Exp_SendCmd,	(ClientData)"exp_user",	0},
+{"send_queue",	Exp_SendQueueCmd,	0,	0},
+{"send_tty",	0,	(ClientData)"exp_tty",	0,	Exp_SendObjCmd},
+{"send_user",	0,	(ClientData)"exp_user",	0,	Exp_SendObjCmd},
 {"sleep",	Exp_SleepCmd,	0,	0},
+#ifdef __WIN32__
+{"spawn",	0,	0,	0,	Exp_SpawnObjCmd},
+#else
 {"spawn",	Exp_SpawnCmd,	0,	0},
+#endif
 {"strace",	Exp_StraceCmd,	0,	0},
-{"wait",	Exp_WaitCmd,	0,	0},
+{"wait",	0,	0,	0,	Exp_WaitObjCmd},
 {0}};
 
 /*
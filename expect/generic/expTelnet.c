@@ -0,0 +1,620 @@
+/*
+ * expTelnet.c --
+ *
+ *	Implements spawn -tcp and spawn -telnet.  Rather than running a
+ *	telnet process on a pty for each connection, the spawn id is a
+ *	socket channel opened by expect itself.  For -telnet, the socket
+ *	is wrapped in an exp_telnet channel that does the telnet protocol:
+ *	option negotiation is answered and removed from the input, and
+ *	output is escaped, so that expect sees the same characters it
+ *	would have seen through a telnet process.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include "exp_port.h"
+#include "tclInt.h"
+#include "tclPort.h"
+#include "exp_rename.h"
+#include "exp_prog.h"
+#include "exp_command.h"
+#include "exp_log.h"
+
+/*
+ * Telnet commands and options (RFC 854, 857, 858)
+ */
+
+#define TN_SE		240	/* end of subnegotiation */
+#define TN_SB		250	/* start of subnegotiation */
+#define TN_WILL		251
+#define TN_WONT		252
+#define TN_DO		253
+#define TN_DONT		254
+#define TN_IAC		255	/* interpret as command */
+
+#define TN_ECHO		1
+#define TN_SGA		3	/* suppress go ahead */
+
+/*
+ * States of the input parser
+ */
+
+#define TS_DATA		0
+#define TS_CR		1	/* after a CR, which may be followed by NUL */
+#define TS_IAC		2
+#define TS_OPT		3	/* after WILL, WONT, DO or DONT */
+#define TS_SB		4	/* in a subnegotiation, which is ignored */
+#define TS_SB_IAC	5
+
+typedef struct ExpTelnetState {
+    Tcl_Channel channel;	/* The exp_telnet channel */
+    Tcl_Channel sock;		/* The socket it is layered over */
+    int state;			/* TS_ state of the input parser */
+    int verb;			/* WILL, WONT, DO or DONT, in TS_OPT */
+    char remote[256];		/* options the server has enabled */
+    char local[256];		/* options we have enabled */
+    char owed[32];		/* what must go out before anything else: */
+    int owedLen;		/* the second half of an escape, or */
+				/* replies the socket didn't take */
+} ExpTelnetState;
+
+static int	ExpTelnetBlock _ANSI_ARGS_((ClientData instanceData,
+		    int mode));
+static int	ExpTelnetInput _ANSI_ARGS_((ClientData instanceData,
+		    char *bufPtr, int bufSize, int *errorPtr));
+static int	ExpTelnetOutput _ANSI_ARGS_((ClientData instanceData,
+		    char *bufPtr, int toWrite, int *errorPtr));
+static int	ExpTelnetClose _ANSI_ARGS_((ClientData instanceData,
+		    Tcl_Interp *interp));
+static int	ExpTelnetGetOption _ANSI_ARGS_((ClientData instanceData,
+		    Tcl_Interp *interp, char *nameStr, Tcl_DString *dsPtr));
+static int	ExpTelnetGetHandle _ANSI_ARGS_((ClientData instanceData,
+		    int direction, ClientData *handlePtr));
+static void	ExpTelnetWatch _ANSI_ARGS_((ClientData instanceData,
+		    int mask));
+static void	ExpTelnetNotify _ANSI_ARGS_((ClientData clientData,
+		    int mask));
+static int	ExpTelnetFlush _ANSI_ARGS_((ExpTelnetState *tsPtr,
+		    int *errorPtr));
+static void	ExpTelnetReply _ANSI_ARGS_((ExpTelnetState *tsPtr,
+		    int verb, int option));
+static void	ExpTelnetOption _ANSI_ARGS_((ExpTelnetState *tsPtr,
+		    int verb, int option));
+
+static Tcl_ChannelType ExpTelnetChannelType = {
+    "exp_telnet",
+    ExpTelnetBlock,
+    ExpTelnetClose,
+    ExpTelnetInput,
+    ExpTelnetOutput,
+    NULL,         		/* Can't seek! */
+    NULL,			/* Sockets have no options to set */
+    ExpTelnetGetOption,
+    ExpTelnetWatch,
+    ExpTelnetGetHandle
+};
+
+static int expTelnetCount = 0;
+
+/* call a proc of the socket's channel driver directly */
+#define SockProc(tsPtr,proc) \
+	(Tcl_GetChannelType((tsPtr)->sock)->proc)
+#define SockData(tsPtr) \
+	Tcl_GetChannelInstanceData((tsPtr)->sock)
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpSpawnTcp --
+ *
+ *	Handle 'spawn -tcp' and 'spawn -telnet'.  Called from
+ *	Exp_SpawnCmd.  Connects to port on host and makes the
+ *	connection a spawn id, as 'spawn -open' would.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side Effects:
+ *	spawn_id is set to the new spawn id.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+ExpSpawnTcp(interp, host, port, telnet)
+    Tcl_Interp *interp;
+    char *host;
+    char *port;
+    int telnet;			/* speak the telnet protocol */
+{
+    Tcl_Channel chan;
+    ExpTelnetState *tsPtr;
+    char channelNameStr[20];
+    int portNum;
+
+    if (TclSockGetPort(interp, port, "tcp", &portNum) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    chan = Tcl_OpenTcpClient(interp, portNum, host, NULL, 0, 0);
+    if (chan == NULL) {
+	return TCL_ERROR;
+    }
+
+    if (telnet) {
+	tsPtr = (ExpTelnetState *) ckalloc(sizeof(ExpTelnetState));
+	memset((char *) tsPtr, 0, sizeof(ExpTelnetState));
+	tsPtr->sock = chan;
+	tsPtr->state = TS_DATA;
+
+	sprintf(channelNameStr, "exp_telnet%d", expTelnetCount++);
+	chan = Tcl_CreateChannel(&ExpTelnetChannelType, channelNameStr,
+				 (ClientData) tsPtr, TCL_READABLE|TCL_WRITABLE);
+	tsPtr->channel = chan;
+    }
+
+    /*
+     * As for spawned processes, a read must return what is there
+     * rather than wait to fill the buffer.
+     */
+
+    Tcl_SetChannelOption(interp, chan, "-blocking", "0");
+    Tcl_SetChannelOption(interp, chan, "-buffering", "none");
+    Tcl_SetChannelOption(interp, chan, "-translation", "binary");
+    Tcl_RegisterChannel(interp, chan);
+
+    return ExpSpawnOpen(interp, Tcl_GetChannelName(chan), FALSE);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetBlock --
+ *
+ *	Set the socket to blocking or non-blocking.
+ *
+ * Results:
+ *	0 if successful, a POSIX error code if not.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetBlock(instanceData, mode)
+    ClientData instanceData;
+    int mode;			/* (in) Block or not */
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+
+    return SockProc(tsPtr,blockModeProc)(SockData(tsPtr), mode);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetInput --
+ *
+ *	Read from the socket, answering and removing any telnet
+ *	commands.
+ *
+ * Returns:
+ *	Amount read or -1 with errorcode in errorPtr.  Input that was
+ *	all telnet commands looks like a read that would block, since
+ *	0 would mean eof.
+ *
+ * Side Effects:
+ *	Replies to option negotiation are written to the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetInput(instanceData, bufPtr, bufSize, errorPtr)
+    ClientData instanceData;
+    char *bufPtr;		/* (in) Ptr to buffer */
+    int bufSize;		/* (in) sizeof buffer */
+    int *errorPtr;		/* (out) error code */
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+    unsigned char *s, *d, *end;
+    int n;
+
+    do {
+	n = SockProc(tsPtr,inputProc)(SockData(tsPtr), bufPtr, bufSize,
+				      errorPtr);
+	if (n <= 0) {
+	    return n;
+	}
+
+	/* the data is squeezed down in place as commands are removed */
+	s = d = (unsigned char *) bufPtr;
+	for (end = s + n;s < end;s++) {
+	    switch (tsPtr->state) {
+	    case TS_CR:
+		tsPtr->state = TS_DATA;
+		if (*s == 0) break;
+		/* FALLTHROUGH */
+	    case TS_DATA:
+		if (*s == TN_IAC) {
+		    tsPtr->state = TS_IAC;
+		} else {
+		    if (*s == '\r') tsPtr->state = TS_CR;
+		    *d++ = *s;
+		}
+		break;
+	    case TS_IAC:
+		switch (*s) {
+		case TN_IAC:		/* an escaped 255 */
+		    *d++ = *s;
+		    tsPtr->state = TS_DATA;
+		    break;
+		case TN_WILL:
+		case TN_WONT:
+		case TN_DO:
+		case TN_DONT:
+		    tsPtr->verb = *s;
+		    tsPtr->state = TS_OPT;
+		    break;
+		case TN_SB:
+		    tsPtr->state = TS_SB;
+		    break;
+		default:		/* NOP, GA and the like */
+		    tsPtr->state = TS_DATA;
+		    break;
+		}
+		break;
+	    case TS_OPT:
+		ExpTelnetOption(tsPtr, tsPtr->verb, *s);
+		tsPtr->state = TS_DATA;
+		break;
+	    case TS_SB:
+		if (*s == TN_IAC) tsPtr->state = TS_SB_IAC;
+		break;
+	    case TS_SB_IAC:
+		tsPtr->state = (*s == TN_SE) ? TS_DATA : TS_SB;
+		break;
+	    }
+	}
+	n = d - (unsigned char *) bufPtr;
+    } while (n == 0);
+
+    return n;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetOption --
+ *
+ *	Answer the server's WILL, WONT, DO or DONT for an option.  The
+ *	server may echo and suppress go ahead, and so may we, which is
+ *	what a telnet process would agree to.  Everything else is
+ *	refused.  Nothing is said about an option already in the state
+ *	asked for, so negotiation can't loop (RFC 854).
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	A reply may be written to the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpTelnetOption(tsPtr, verb, option)
+    ExpTelnetState *tsPtr;
+    int verb;
+    int option;
+{
+    switch (verb) {
+    case TN_WILL:
+	if (tsPtr->remote[option]) return;
+	if (option == TN_ECHO || option == TN_SGA) {
+	    tsPtr->remote[option] = TRUE;
+	    ExpTelnetReply(tsPtr, TN_DO, option);
+	} else {
+	    ExpTelnetReply(tsPtr, TN_DONT, option);
+	}
+	break;
+    case TN_WONT:
+	if (!tsPtr->remote[option]) return;
+	tsPtr->remote[option] = FALSE;
+	ExpTelnetReply(tsPtr, TN_DONT, option);
+	break;
+    case TN_DO:
+	if (tsPtr->local[option]) return;
+	if (option == TN_SGA) {
+	    tsPtr->local[option] = TRUE;
+	    ExpTelnetReply(tsPtr, TN_WILL, option);
+	} else {
+	    ExpTelnetReply(tsPtr, TN_WONT, option);
+	}
+	break;
+    case TN_DONT:
+	if (!tsPtr->local[option]) return;
+	tsPtr->local[option] = FALSE;
+	ExpTelnetReply(tsPtr, TN_WONT, option);
+	break;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetFlush --
+ *
+ *	Write what is owed to the socket: the second half of an escape
+ *	split by a short write, and replies that didn't fit.  Nothing
+ *	else may go out until this has, or the server would read the
+ *	halves of an escape with something else in between.
+ *
+ * Results:
+ *	0 once nothing is owed, or -1 with errorcode in errorPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetFlush(tsPtr, errorPtr)
+    ExpTelnetState *tsPtr;
+    int *errorPtr;		/* (out) error code */
+{
+    int written;
+
+    if (tsPtr->owedLen == 0) return 0;
+
+    written = SockProc(tsPtr,outputProc)(SockData(tsPtr), tsPtr->owed,
+					 tsPtr->owedLen, errorPtr);
+    if (written < 0) return -1;
+    tsPtr->owedLen -= written;
+    if (tsPtr->owedLen) {
+	memmove(tsPtr->owed, tsPtr->owed + written, tsPtr->owedLen);
+	*errorPtr = EAGAIN;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetReply --
+ *
+ *	Write a three byte telnet command to the socket, after anything
+ *	already owed.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	A reply is written, or kept to be written before the next
+ *	output.  There is nowhere to report an error, so it is only
+ *	logged, and a reply that doesn't fit with what is owed is lost.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpTelnetReply(tsPtr, verb, option)
+    ExpTelnetState *tsPtr;
+    int verb;
+    int option;
+{
+    char *reply;
+    int err;
+
+    debuglog("telnet: sending %s %d\r\n",
+	     (verb == TN_DO) ? "DO" :
+	     (verb == TN_DONT) ? "DONT" :
+	     (verb == TN_WILL) ? "WILL" : "WONT", option);
+    if (tsPtr->owedLen + 3 > sizeof(tsPtr->owed)) {
+	debuglog("telnet: reply not sent\r\n");
+	return;
+    }
+    reply = tsPtr->owed + tsPtr->owedLen;
+    reply[0] = (char) TN_IAC;
+    reply[1] = (char) verb;
+    reply[2] = (char) option;
+    tsPtr->owedLen += 3;
+    if (ExpTelnetFlush(tsPtr, &err) < 0 && err != EAGAIN) {
+	debuglog("telnet: reply not sent\r\n");
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetOutput --
+ *
+ *	Write to the socket.  A 255 is doubled, and a CR not followed
+ *	by a LF is sent as CR NUL.
+ *
+ * Results:
+ *	Amount of bufPtr written or -1 with errorcode in errorPtr
+ *
+ * Side Effects:
+ *	Anything owed is sent first.  If only half of an escape fits in
+ *	the socket's buffer, the other half is owed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetOutput(instanceData, bufPtr, toWrite, errorPtr)
+    ClientData instanceData;
+    char *bufPtr;		/* (in) Ptr to buffer */
+    int toWrite;		/* (in) amount to write */
+    int *errorPtr;		/* (out) error code */
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+    char *out;
+    int i, n, written, done;
+
+    if (ExpTelnetFlush(tsPtr, errorPtr) < 0) {
+	return -1;
+    }
+
+    out = ckalloc(2 * toWrite);
+    for (i = 0, n = 0;i < toWrite;i++) {
+	out[n++] = bufPtr[i];
+	if ((unsigned char) bufPtr[i] == TN_IAC) {
+	    out[n++] = (char) TN_IAC;
+	} else if (bufPtr[i] == '\r'
+		   && (i + 1 == toWrite || bufPtr[i+1] != '\n')) {
+	    out[n++] = '\0';
+	}
+    }
+
+    written = SockProc(tsPtr,outputProc)(SockData(tsPtr), out, n, errorPtr);
+    if (written < 0) {
+	ckfree(out);
+	return -1;
+    }
+
+    /* find how much of bufPtr that was */
+    for (i = 0, done = 0;done < written;i++) {
+	done++;
+	if ((unsigned char) bufPtr[i] == TN_IAC
+	    || (bufPtr[i] == '\r'
+		&& (i + 1 == toWrite || bufPtr[i+1] != '\n'))) {
+	    if (done == written) {
+		tsPtr->owed[0] = out[done];
+		tsPtr->owedLen = 1;
+	    } else done++;
+	}
+    }
+    ckfree(out);
+
+    if (i == 0) {
+	*errorPtr = EAGAIN;
+	return -1;
+    }
+    return i;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetClose --
+ *
+ *	Close the socket along with the telnet channel.
+ *
+ * Results:
+ *      0 if successful or a POSIX errorcode with
+ *      interp updated.
+ *
+ * Side Effects:
+ *	Channel is deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetClose(instanceData, interp)
+    ClientData instanceData;
+    Tcl_Interp *interp;
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+    int ret;
+
+    Tcl_DeleteChannelHandler(tsPtr->sock, ExpTelnetNotify,
+			     (ClientData) tsPtr);
+    ret = Tcl_Close(interp, tsPtr->sock);
+    ckfree((char *) tsPtr);
+    return ret;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetGetOption --
+ *
+ *	Query the socket for the current value of an option, such
+ *	as -peername.
+ *
+ * Results:
+ *	TCL_OK and dsPtr updated with the value or TCL_ERROR.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetGetOption(instanceData, interp, nameStr, dsPtr)
+    ClientData instanceData;
+    Tcl_Interp *interp;
+    char *nameStr;		/* (in) Name of option to retrieve */
+    Tcl_DString *dsPtr;		/* (in) String to place value */
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+
+    return SockProc(tsPtr,getOptionProc)(SockData(tsPtr), interp,
+					 nameStr, dsPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetGetHandle --
+ *
+ *	Get the socket's OS handle.
+ *
+ * Results:
+ *	TCL_OK and the handle in handlePtr, or TCL_ERROR.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpTelnetGetHandle(instanceData, direction, handlePtr)
+    ClientData instanceData;
+    int direction;
+    ClientData *handlePtr;
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+
+    return SockProc(tsPtr,getHandleProc)(SockData(tsPtr), direction,
+					 handlePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpTelnetWatch --
+ *
+ *	Arrange to hear about events on the telnet channel.  The
+ *	socket's driver notifies the socket's channel, so this watches
+ *	that channel and passes what it hears on.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpTelnetWatch(instanceData, mask)
+    ClientData instanceData;
+    int mask;
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) instanceData;
+
+    if (mask) {
+	Tcl_CreateChannelHandler(tsPtr->sock, mask, ExpTelnetNotify,
+				 (ClientData) tsPtr);
+    } else {
+	Tcl_DeleteChannelHandler(tsPtr->sock, ExpTelnetNotify,
+				 (ClientData) tsPtr);
+    }
+}
+
+static void
+ExpTelnetNotify(clientData, mask)
+    ClientData clientData;
+    int mask;
+{
+    ExpTelnetState *tsPtr = (ExpTelnetState *) clientData;
+
+    Tcl_NotifyChannel(tsPtr->channel, mask);
+}
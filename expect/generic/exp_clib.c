@@ -46,6 +46,7 @@ int exp_match_max = EXP_MATCH_MAX;	/* bytes */
 int exp_full_buffer = FALSE;		/* don't return on full buffer */
 int exp_remove_nulls = TRUE;
 int exp_timeout = 10;			/* seconds */
+int exp_timeout_msec = -1;		/* if not -1, overrides exp_timeout */
 int exp_pty_timeout = 5;		/* seconds - see CRAY below */
 int exp_autoallocpty = TRUE;		/* if TRUE, we do allocation */
 int exp_pty[2];				/* master is [0], slave is [1] */
@@ -415,8 +416,9 @@ exp_expectv(handle,ecases)
 
     struct exp_case *ec;	/* points to current ecase */
 
-    time_t current_time;	/* current time (when we last looked)*/
-    time_t end_time;		/* future time at which to give up */
+    long current_time;		/* exp_msec when we last looked */
+    long end_time;		/* exp_msec at which to give up */
+    int timeout;		/* milliseconds */
     int remtime;		/* remaining time in timeout */
     Tcl_Channel channel;
     int key;
@@ -445,67 +447,46 @@ exp_expectv(handle,ecases)
 	}
     }
 
-    exp_buffer = f->buffer;
-    exp_buffer_end = exp_buffer + f->size;
-    exp_match_end = &f->buffer[f->matched];
+    /*
+     * drop everything up to the end of the previous match.  The
+     * buffer is resized and shifted through the same helpers the
+     * expect command uses, so that its offset, capacity and
+     * lowercase copy stay consistent.
+     */
+    exp_buffer_discard(f,f->matched);
+    f->matched = 0;
 
-    buf_length = exp_buffer_end - exp_match_end;
-    if (buf_length) {
-	/*
-	 * take end of previous match to end of buffer
-	 * and copy to beginning of buffer
-	 */
-	memmove(exp_buffer,exp_match_end,buf_length);
-    }			
-    f->size = buf_length;
-    f->printed = buf_length;
+    /* get the latest buffer size.  exp_adjust doubles the user */
+    /* input, so that a match may straddle two bufferfuls, and */
+    /* forgets about the oldest data if the buffer shrinks */
+    f->umsize = exp_match_max;
+    exp_adjust(f);
+    f->printed = f->size;
+    bufsiz = f->msize + 1;
+
+    exp_buffer = f->buffer;
+    buf_length = f->size;
     exp_buffer_end = exp_buffer + buf_length;
-    *exp_buffer_end = '\0';
-
-    /* get the latest buffer size.  Double the user input for two */
-    /* reasons.  1) Need twice the space in case the match */
-    /* straddles two bufferfuls, 2) easier to hack the division by */
-    /* two when shifting the buffers later on */
-
-    bufsiz = 2*exp_match_max;
-    if (f->msize != bufsiz-1) {
-	/* if truncated, forget about some data */
-	if (buf_length > bufsiz) {
-	    /* copy end of buffer down */
-
-	    /* copy one less than what buffer can hold to avoid */
-	    /* triggering buffer-full handling code below */
-	    /* which will immediately dump the first half */
-	    /* of the buffer */
-	    debuglog("expectlib(%d): copy end of buffer down 1\r\n", pid);
-	    memmove(exp_buffer,exp_buffer+(buf_length - bufsiz)+1,
-		bufsiz-1);
-	    buf_length = bufsiz-1;
-	    f->size = bufsiz-1;
-	    f->printed = bufsiz-1;
-	    f->buffer[f->size] = '\0';
-	}
-	exp_buffer = ckrealloc(exp_buffer,bufsiz);
-	if (!exp_buffer) return_errno(ENOMEM);
-	exp_buffer[buf_length] = '\0';
-	exp_buffer_end = exp_buffer + buf_length;
-	f->buffer = exp_buffer;
-	f->msize = bufsiz-1;
-    }
+
+    if (exp_timeout_msec != -1) timeout = exp_timeout_msec;
+    else if (exp_timeout < 0) timeout = exp_timeout;
+    /* as with the timeout variable, too long to count in ms is forever */
+    else if (exp_timeout >= 0x7fffffff/1000) timeout = EXP_TIME_INFINITY;
+    else timeout = 1000*exp_timeout;
 
     /* remtime and current_time updated at bottom of loop */
-    remtime = exp_timeout;
+    remtime = timeout;
 
-    time(&current_time);
+    current_time = exp_msec();
 restart:
-    end_time = current_time + remtime;
+    end_time = exp_msec_add(current_time,remtime);
     key = f->key + 1;
 
     for (;;) {
 	/* when buffer fills, copy second half over first and */
 	/* continue, so we can do matches over multiple buffers */
 	if (buf_length == bufsiz-1) {
-	    int first_half, second_half;
+	    int first_half;
 
 	    if (exp_full_buffer) {
 		debuglog("expectlib(%d): full buffer\r\n", pid);
@@ -515,15 +496,13 @@ restart:
 		return_normally(EXP_FULLBUFFER);
 	    }
 	    first_half = bufsiz/2;
-	    second_half = bufsiz - first_half;
 
 	    debuglog("expectlib(%d): copy end of buffer down 2\r\n", pid);
-	    memmove(exp_buffer,exp_buffer+first_half,second_half);
-	    buf_length = second_half-1;
-	    exp_buffer_end = exp_buffer + second_half;
-	    f->size = buf_length;
-	    f->printed = buf_length;
-	    f->buffer[f->size] = '\0';
+	    exp_buffer_discard(f,first_half);
+	    f->printed = f->size;
+	    exp_buffer = f->buffer;
+	    buf_length = f->size;
+	    exp_buffer_end = exp_buffer + buf_length;
 	}
 
 	/*
@@ -537,7 +516,7 @@ restart:
 	/*
 	 * check for timeout
 	 */
-	if ((exp_timeout >= 0) && ((remtime < 0) || polled)) {
+	if ((timeout >= 0) && ((remtime < 0) || polled)) {
 	    debuglog("expectlib(%d): timeout\r\n", pid);
 	    exp_match_end = exp_buffer;
 	    return_normally(EXP_TIMEOUT);
@@ -547,7 +526,7 @@ restart:
 	 * if timeout == 0, indicate a poll has
 	 * occurred so that next time through loop causes timeout
 	 */
-	if (exp_timeout == 0) {
+	if (timeout == 0) {
 	    polled = 1;
 	}
 
@@ -562,7 +541,9 @@ restart:
 	    goto restart;
 	} else {
 	    debuglog("expectlib(%d): read %d bytes\n", pid, cc);
-	    exp_buffer[buf_length+cc] = 0;
+	    /* expect_read has already appended the chars to f */
+	    exp_buffer = f->buffer;
+	    buf_length = f->size - cc;
 	    debuglog("expectlib(%d): read %s\n", pid,
 		     exp_printify(&exp_buffer[buf_length]));
 #if 0
@@ -644,8 +625,8 @@ restart:
 	 * Update current time and remaining time.
 	 * Don't bother if we are waiting forever or polling.
 	 */
-	if (exp_timeout > 0) {
-	    time(&current_time);
+	if (timeout > 0) {
+	    current_time = exp_msec();
 	    remtime = end_time - current_time;
 	}
 
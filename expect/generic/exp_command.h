@@ -24,6 +24,12 @@ EXTERN int		exp_one_arg_braced _ANSI_ARGS_((char *));
 EXTERN int		exp_eval_with_one_arg _ANSI_ARGS_((ClientData,
 				Tcl_Interp *,char **));
 EXTERN void		exp_lowmemcpy _ANSI_ARGS_((char *,char *,int));
+EXTERN int		exp_condition _ANSI_ARGS_((char *,int,int));
+EXTERN long		exp_msec _ANSI_ARGS_((void));
+EXTERN int		exp_msec_arg _ANSI_ARGS_((char *));
+EXTERN long		exp_msec_add _ANSI_ARGS_((long, int));
+EXTERN double		exp_usec _ANSI_ARGS_((void));
+EXTERN int		exp_squeeze _ANSI_ARGS_((char *,int,char *));
 
 EXTERN int exp_flageq_code _ANSI_ARGS_((char *,char *,int));
 
@@ -117,6 +123,45 @@ EXTERN int exp_flageq_code _ANSI_ARGS_((char *,char *,int));
 /* each process is associated with a 'struct exp_f'.  An array of these */
 /* ('exp_fs') keeps track of all processes.  They are indexed by the true fd */
 /* to the master side of the pty */
+/*
+ * Counters kept for each spawn id and reported by expect_stats.  They
+ * are cheap enough to keep all the time, unlike exp_internal.
+ */
+struct exp_stats {
+	long reads;		/* reads that returned data */
+	long read_bytes;	/* bytes they returned */
+	long writes;		/* writes that took data */
+	long write_bytes;	/* bytes they took */
+	long glob;		/* glob patterns tried against the buffer */
+	long re;		/* regular expressions tried */
+	long exact;		/* exact strings tried */
+	long null;		/* null patterns tried */
+	long full_buffer;	/* full_buffer patterns tried */
+	long matches;		/* how many of the above matched */
+	long match_usec;	/* microseconds spent trying them */
+	long shuffles;		/* times a full buffer was cut in half */
+	long discarded;		/* bytes removed without being matched */
+};
+
+/*
+ * A file being written by log_file.  The one without -i is always the
+ * channel in logfile; a spawn id's own log (log_file -i) hangs off its
+ * exp_f.
+ */
+struct exp_log {
+	Tcl_Channel chan;
+	char *filename;		/* if log_file opened it, else 0 */
+	int bufsize;		/* output is collected in a buffer this */
+				/* big, or written at once if 0 */
+	int flush_ms;		/* buffered output is flushed this often */
+	Tcl_TimerToken flush_timer;
+	long rotate_size;	/* a new file is begun after this many */
+	long rotate_secs;	/* bytes or seconds, unless 0.  The old */
+	int keep;		/* ones are kept as filename.1 .. .keep */
+	long written;		/* bytes written to the current file */
+	long opened;		/* time(3) when it was begun */
+};
+
 struct exp_f {
 	char *spawnId;	/* Spawn identifier name */
 	Tcl_HashEntry *hashPtr;	/* The hash entry with this structure */
@@ -124,10 +169,17 @@ struct exp_f {
 	int pid;	/* pid or EXP_NOPID if no pid */
 	Tcl_Pid tclPid;	/* The pid that tcl wants */
 	char *buffer;	/* input buffer */
-	char *lower;	/* input buffer in lowercase */
+	char *lower;	/* input buffer in lowercase.  Only allocated and */
+			/* kept up to date while -nocase patterns need */
+			/* it.  See exp_buffer_lower. */
+	int lower_valid;/* # of chars at front of lower that are current */
 	int size;	/* current size of data */
 	int msize;	/* size of buffer (true size is one greater
 			 * for trailing null) */
+	int offset;	/* where buffer and lower begin within the space */
+			/* allocated for them.  Discarding chars from the */
+			/* front just moves them up. */
+	int cap;	/* # of bytes allocated for buffer (and lower) */
 	int umsize;	/* user view of size of buffer */
 	int rm_nulls;	/* if nulls should be stripped before pat matching */
 	int valid;	/* if any of the other fields should be believed */
@@ -146,8 +198,26 @@ struct exp_f {
 			/* last touched this buffer */
 	int force_read;	/* force read to occur (even if buffer already has */
 			/* data).  This supports interact CAN_MATCH */
+	int generation;	/* bumped whenever chars are removed from the */
+			/* front of buffer.  Scan positions remembered by */
+			/* ecases are only good for one generation */
 	int fg_armed;	/* If Tk_CreateFileHandler is active for responding */
 			/* to foreground events */
+	int ready_mask;	/* if nonzero, the events this is queued as ready */
+			/* for, waiting to be handed out by */
+			/* exp_get_next_event */
+	struct exp_f *ready_next;	/* next in that queue */
+	char *outq;	/* output from send -nowait not yet written */
+	int outq_size;	/* # of chars in outq */
+	int outq_msize;	/* # of chars outq can hold */
+	int outq_hiwater;	/* when outq_size reaches this, */
+	char *outq_cmd;		/* evaluate this (if set) */
+	int outq_armed;	/* if a writable handler is flushing outq */
+	struct exp_pace *pace_head;	/* chunks of send -s or -h */
+	struct exp_pace *pace_tail;	/* not yet written */
+	Tcl_TimerToken pace_timer;	/* writes pace_head when it fires */
+	struct exp_stats stats;
+	struct exp_log *log;	/* from log_file -i, or 0 */
 #ifdef _WIN32
 	OVERLAPPED over;	/* Overlapped result */
 #endif
@@ -203,10 +273,14 @@ EXTERN Tcl_HashTable *exp_f_table;
 EXTERN struct exp_f *exp_f_any;
 
 EXTERN struct exp_f *	exp_chan2f _ANSI_ARGS_((Tcl_Interp *,char *,int,int,char *));
+EXTERN struct exp_f *	exp_obj2f _ANSI_ARGS_((Tcl_Interp *,Tcl_Obj *,int,int,char *));
 EXTERN int		exp_fcheck _ANSI_ARGS_((Tcl_Interp *, struct exp_f *,
 			    int,int,char *));
 EXTERN void		exp_adjust _ANSI_ARGS_((struct exp_f *));
 EXTERN void		exp_buffer_shuffle _ANSI_ARGS_((Tcl_Interp *,struct exp_f *,int,char *,char *));
+EXTERN void		exp_buffer_discard _ANSI_ARGS_((struct exp_f *,int));
+EXTERN void		exp_log_write _ANSI_ARGS_((struct exp_log *,char *,int));
+EXTERN char *		exp_buffer_lower _ANSI_ARGS_((struct exp_f *));
 EXTERN int		exp_close_fd _ANSI_ARGS_((Tcl_Interp *,int));
 EXTERN int		exp_close _ANSI_ARGS_((Tcl_Interp *,struct exp_f *));
 EXTERN void		exp_close_all _ANSI_ARGS_((Tcl_Interp *));
@@ -220,6 +294,10 @@ EXTERN void		exp_strftime();
 #define exp_deleteProc ((Tcl_CmdDeleteProc *) NULL)
 
 EXTERN int expect_key;
+EXTERN int exp_buffer_generation;
+
+/* call whenever chars are removed from the front of a spawn id's buffer */
+#define exp_buffer_changed(f)	((f)->generation = ++exp_buffer_generation)
 EXTERN int exp_configure_count;	/* # of times descriptors have been closed */
 				/* or indirect lists have been changed */
 EXTERN int exp_nostack_dump;	/* TRUE if user has requested unrolling of */
@@ -299,6 +377,7 @@ struct exp_cmd_data {
 	Tcl_CmdProc	*proc;
 	ClientData	data;
 	int 		flags;
+	Tcl_ObjCmdProc	*objproc;	/* used instead of proc if set */
 };
 
 EXTERN int		ExpPlatformSpawnOutput _ANSI_ARGS_((
@@ -316,6 +395,8 @@ EXTERN int		exp_getpidproc _ANSI_ARGS_((void));
 EXTERN void		exp_busy _ANSI_ARGS_((int));
 EXTERN int		exp_exact_write _ANSI_ARGS_((struct exp_f *,
 			    char *, int));
+EXTERN int		exp_queue_write _ANSI_ARGS_((Tcl_Interp *,
+			    struct exp_f *, char *, int));
 EXTERN void		exp_sys_close _ANSI_ARGS_((int, struct exp_f *));
 EXTERN struct exp_f *	exp_f_find _ANSI_ARGS_ ((Tcl_Interp *, char *));
 EXTERN struct exp_f *	exp_f_new _ANSI_ARGS_((Tcl_Interp *, Tcl_Channel,
@@ -327,9 +408,11 @@ EXTERN void		exp_f_free_platform _ANSI_ARGS_((struct exp_f *));
 EXTERN Tcl_Channel	ExpCreatePairChannel _ANSI_ARGS_((Tcl_Interp *,
 			    char *, char *, char *chanName));
 EXTERN int		ExpSpawnOpen _ANSI_ARGS_((Tcl_Interp *, char *, int));
+EXTERN int		ExpSpawnTcp _ANSI_ARGS_((Tcl_Interp *, char *, char *,
+			    int));
 
-EXTERN int		Exp_CloseCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int		Exp_CloseObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]));
 EXTERN int		Exp_DebugCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_DisconnectCmd _ANSI_ARGS_((ClientData clientData,
@@ -344,10 +427,10 @@ EXTERN int		Exp_ExpInternalCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_ExpPidCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_ExpectCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_ExpectGlobalCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int		Exp_ExpectObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]));
+EXTERN int		Exp_ExpectGlobalObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]));
 EXTERN int		Exp_ExpVersionCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_ForkCmd _ANSI_ARGS_((ClientData clientData,
@@ -378,22 +461,17 @@ EXTERN int		Exp_Prompt2Cmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_RemoveNullsCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_SendCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_SendCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_SendCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_SendCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_SendCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int		Exp_SendObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]));
 EXTERN int		Exp_SendLogCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_SleepCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_SpawnCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int		Exp_SpawnObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc,
+			    Tcl_Obj *CONST objv[]));
 EXTERN int		Exp_StraceCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_SttyCmd _ANSI_ARGS_((ClientData clientData,
@@ -404,7 +482,7 @@ EXTERN int		Exp_TimestampCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 EXTERN int		Exp_TrapCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
-EXTERN int		Exp_WaitCmd _ANSI_ARGS_((ClientData clientData,
-			    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int		Exp_WaitObjCmd _ANSI_ARGS_((ClientData clientData,
+			    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]));
 
 #endif /* _EXP_COMMAND_H */
@@ -0,0 +1,188 @@
+/* exp_condition.c - prepare chars read from a spawn id for matching
+
+Every char read from a spawned process may need its parity stripped,
+has to be checked for nulls (which Tcl can't hold in a string), and,
+for -nocase patterns, needs a lowercase copy.  Done as separate loops,
+each of these is a pass over every byte read, which adds up on
+processes producing a lot of output.  The routines here do as much of
+this as possible in one pass.  Where the compiler supports SSE2 they
+work 16 bytes at a time.
+
+Nulls are only counted on the way in, since the log file and the user
+see the output with its nulls.  Removing them is left to exp_squeeze,
+which also does the lowercase copy if one is wanted, so that output
+without nulls only ever needs the first pass.
+
+*/
+
+#include <string.h>
+#include <ctype.h>
+
+#include "exp_port.h"
+#include "tcl.h"
+#include "exp_command.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define EXP_SSE2
+#include <emmintrin.h>
+#endif
+
+#define exp_lower(c)	((isascii(c) && isupper(c))?tolower(c):(c))
+
+#ifdef EXP_SSE2
+/* number of bits set in a 16-bit mask */
+static int
+exp_bits16(mask)
+    unsigned int mask;
+{
+    int count = 0;
+
+    for (;mask;mask &= mask - 1) count++;
+    return count;
+}
+
+/* lowercase the ASCII letters of 16 chars */
+static __m128i
+exp_lower16(c)
+    __m128i c;
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c,_mm_set1_epi8('A'-1)),
+				  _mm_cmplt_epi8(c,_mm_set1_epi8('Z'+1)));
+
+    return _mm_add_epi8(c,_mm_and_si128(upper,_mm_set1_epi8('a'-'A')));
+}
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_condition --
+ *
+ *	Condition the n chars just read into s: strip their parity if
+ *	strip is set, and count the nulls among them.
+ *
+ * Results:
+ *	Number of nulls in s.
+ *
+ * Side Effects:
+ *	s is modified in place if strip is set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_condition(s,n,strip)
+    char *s;
+    int n;
+    int strip;
+{
+    char *end = s + n;
+    int nulls = 0;
+
+#ifdef EXP_SSE2
+    {
+	__m128i zero = _mm_setzero_si128();
+	__m128i seven = _mm_set1_epi8(0x7f);
+
+	for (;s + 16 <= end;s += 16) {
+	    __m128i c = _mm_loadu_si128((__m128i *)s);
+
+	    if (strip) {
+		c = _mm_and_si128(c,seven);
+		_mm_storeu_si128((__m128i *)s,c);
+	    }
+	    nulls += exp_bits16(_mm_movemask_epi8(_mm_cmpeq_epi8(c,zero)));
+	}
+    }
+#endif
+
+    if (strip) {
+	for (;s < end;s++) {
+	    if (0 == (*s &= 0x7f)) nulls++;
+	}
+    } else {
+	while (s < end && (s = memchr(s,0,end - s))) {
+	    nulls++;
+	    s++;
+	}
+    }
+    return nulls;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_squeeze --
+ *
+ *	Remove the nulls from the n chars at s.  If lower is not NULL,
+ *	also leave a lowercase copy of the result there.
+ *
+ * Results:
+ *	Number of chars left in s.
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_squeeze(s,n,lower)
+    char *s;
+    int n;
+    char *lower;
+{
+    char *end = s + n;
+    char *first = memchr(s,0,n);	/* up to here, nothing moves */
+    char *d;
+
+    if (!first) first = end;
+    if (lower) {
+	exp_lowmemcpy(lower,s,first - s);
+	lower += first - s;
+    }
+
+    for (d = first;first < end;first++) {
+	if (*first == 0) continue;
+	*d++ = *first;
+	if (lower) {
+	    *lower++ = exp_lower(*first);
+	}
+    }
+    return d - s;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_lowmemcpy --
+ *
+ *	Like memcpy but it lowercases the result.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_lowmemcpy(dest,src,n)
+    char *dest;
+    char *src;
+    int n;
+{
+#ifdef EXP_SSE2
+    for (;n >= 16;n -= 16,src += 16,dest += 16) {
+	_mm_storeu_si128((__m128i *)dest,
+			 exp_lower16(_mm_loadu_si128((__m128i *)src)));
+    }
+#endif
+    for (;n>0;n--) {
+	*dest = exp_lower(*src);
+	src++;	dest++;
+    }
+}
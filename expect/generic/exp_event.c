@@ -30,14 +30,15 @@ expensive.
 #include "exp_command.h"	/* for struct exp_f defs */
 #include "exp_event.h"
 
-/* Tcl_DoOneEvent will call our filehandler which will set the following */
-/* vars enabling us to know where and what kind of I/O we can do */
+/* Tcl_DoOneEvent will call our filehandler which will queue the exp_f, */
+/* enabling us to know where and what kind of I/O we can do.  A single */
+/* wait may find many spawn ids ready, so they are all collected and */
+/* then handed out in the order they were reported */
 /*#define EXP_SPAWN_ID_BAD	-1*/
 /*#define EXP_SPAWN_ID_TIMEOUT	-2*/	/* really indicates a timeout */
 
-static struct exp_f *ready_fs = NULL;
-/* static int ready_fd = EXP_SPAWN_ID_BAD; */
-static int ready_mask;
+static struct exp_f *ready_head = NULL;	/* linked through ready_next */
+static struct exp_f *ready_tail = NULL;
 static int default_mask = TCL_READABLE | TCL_EXCEPTION;
 
 
@@ -49,6 +50,7 @@ static void		exp_timehandler _ANSI_ARGS_ ((ClientData clientData));
 static void		exp_filehandler _ANSI_ARGS_ ((ClientData clientData,
 			    int mask));
 static void		exp_event_exit_real _ANSI_ARGS_ ((Tcl_Interp *interp));
+static struct exp_f *	exp_ready_pop _ANSI_ARGS_ ((void));
 
 
 /*
@@ -376,13 +378,88 @@ static void exp_filehandler(clientData,mask)
     ClientData clientData;
     int mask;
 {
+    struct exp_f *f = (struct exp_f *) clientData;
+
+    exp_event_disarm_fast(f,exp_filehandler);
+
     /*
-     * if input appears, record the fd on which it appeared
+     * if input appears, queue the process on which it appeared
      */
-    ready_fs = (struct exp_f *) clientData;
-    /* ready_fd = *(int *)clientData; */
-    ready_mask = mask;
-    exp_event_disarm_fast(ready_fs,exp_filehandler);
+    if (f->ready_mask) {
+	f->ready_mask |= mask;
+	return;
+    }
+    f->ready_mask = mask;
+    f->ready_next = NULL;
+    if (ready_tail) {
+	ready_tail->ready_next = f;
+    } else {
+	ready_head = f;
+    }
+    ready_tail = f;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_ready_pop --
+ *
+ *	Take the process that has been ready longest off the ready queue.
+ *
+ * Results:
+ *	The process, or NULL if none is ready.  Its ready_mask tells
+ *	what it is ready for.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct exp_f *
+exp_ready_pop()
+{
+    struct exp_f *f = ready_head;
+
+    if (f) {
+	ready_head = f->ready_next;
+	if (ready_head == NULL) ready_tail = NULL;
+	f->ready_next = NULL;
+    }
+    return f;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_event_unqueue --
+ *
+ *	Forget that a process was ready.  Called before the exp_f goes
+ *	away.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_event_unqueue(f)
+    struct exp_f *f;
+{
+    struct exp_f *p, *prev = NULL;
+
+    if (!f->ready_mask) return;
+    f->ready_mask = 0;
+
+    for (p = ready_head; p; prev = p, p = p->ready_next) {
+	if (p != f) continue;
+	if (prev) {
+	    prev->ready_next = f->ready_next;
+	} else {
+	    ready_head = f->ready_next;
+	}
+	if (ready_tail == f) ready_tail = prev;
+	f->ready_next = NULL;
+	break;
+    }
 }
 
 /*
@@ -411,7 +488,7 @@ int exp_get_next_event(interp,masters, n,master_out,timeout,key)
     struct exp_f **masters;	/* Array of expect process structures */
     int n;			/* # of masters */
     struct exp_f **master_out;	/* 1st ready master, not set if none */
-    int timeout;		/* seconds */
+    int timeout;		/* milliseconds */
     int key;
 {
     static rr = 0;	/* round robin ptr */
@@ -450,7 +527,7 @@ int exp_get_next_event(interp,masters, n,master_out,timeout,key)
 
 	if (!timer_created) {
 	    if (timeout >= 0) {
-		timetoken = Tcl_CreateTimerHandler(1000*timeout,
+		timetoken = Tcl_CreateTimerHandler(timeout,
 						   exp_timehandler,
 						   (ClientData)&timer_fired);
 		timer_created = TRUE;
@@ -459,6 +536,7 @@ int exp_get_next_event(interp,masters, n,master_out,timeout,key)
 
 	for (;;) {
 	    int j;
+	    int ready_mask;
 
 	    /* make sure that all fds that should be armed are */
 	    for (j=0;j<n;j++) {
@@ -484,31 +562,42 @@ int exp_get_next_event(interp,masters, n,master_out,timeout,key)
 		}
 	    }
 
-	    Tcl_DoOneEvent(0);	/* do any event */
+	    /* only wait if processes reported by the last wait have */
+	    /* all been handed out */
+	    if (ready_head == NULL) {
+		Tcl_DoOneEvent(0);	/* do any event */
 
-	    if (timer_fired) return(EXP_TIMEOUT);
+		/* the wait queued an event for every channel it found */
+		/* ready, so collect the rest of them now too */
+		while (Tcl_ServiceEvent(TCL_FILE_EVENTS)) {
+		    /* empty */
+		}
 
-	    if (old_configure_count != exp_configure_count) {
-		if (timer_created)
-		    Tcl_DeleteTimerHandler(timetoken);
-		return EXP_RECONFIGURE;
+		if (timer_fired) return(EXP_TIMEOUT);
+
+		if (old_configure_count != exp_configure_count) {
+		    if (timer_created)
+			Tcl_DeleteTimerHandler(timetoken);
+		    return EXP_RECONFIGURE;
+		}
 	    }
 
-	    if (ready_fs == NULL) continue;
+	    f = exp_ready_pop();
+	    if (f == NULL) continue;
+	    ready_mask = f->ready_mask;
+	    f->ready_mask = 0;
 
 	    /* if it was from something we're not looking for at */
 	    /* the moment, ignore it */
 	    for (j=0;j<n;j++) {
-		if (ready_fs == masters[j]) goto found;
+		if (f == masters[j]) goto found;
 	    }
 
 	    /* not found */
-	    exp_event_disarm_fast(ready_fs,exp_filehandler);
-	    ready_fs = NULL;
+	    exp_event_disarm_fast(f,exp_filehandler);
 	    continue;
 	found:
-	    *master_out = ready_fs;
-	    ready_fs = NULL;
+	    *master_out = f;
 
 	    if (timer_created) Tcl_DeleteTimerHandler(timetoken);
 
@@ -619,6 +708,7 @@ exp_dsleep(interp,sec)
     double sec;
 {
     int timer_fired = FALSE;
+    struct exp_f *f;
 
     Tcl_CreateTimerHandler((int)(sec*1000),exp_timehandler,(ClientData)&timer_fired);
 
@@ -626,10 +716,10 @@ exp_dsleep(interp,sec)
 	Tcl_DoOneEvent(0);
 	if (timer_fired) return TCL_OK;
 
-	if (ready_fs == NULL) continue;
-
-	exp_event_disarm_fast(ready_fs,exp_filehandler);
-	ready_fs = NULL;
+	while ((f = exp_ready_pop()) != NULL) {
+	    f->ready_mask = 0;
+	    exp_event_disarm_fast(f,exp_filehandler);
+	}
     }
 }
 
@@ -8,6 +8,7 @@ extern int		exp_dsleep _ANSI_ARGS_((Tcl_Interp *, double));
 extern void		exp_init_event _ANSI_ARGS_((void));
 extern void		(*exp_event_exit) _ANSI_ARGS_((Tcl_Interp *));
 extern void		exp_event_disarm _ANSI_ARGS_((struct exp_f *));
+extern void		exp_event_unqueue _ANSI_ARGS_((struct exp_f *));
 extern void		exp_arm_background_filehandler _ANSI_ARGS_((
 			    struct exp_f *));
 extern void		exp_disarm_background_filehandler _ANSI_ARGS_((
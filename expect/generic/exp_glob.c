@@ -17,18 +17,59 @@ would appreciate credit if this program or parts of it are used.
 #include "tcl.h"
 #include "exp_int.h"
 
+/*
+ * A compiled glob pattern.
+ *
+ * Every position in the pattern text is a potential state of an NFA:
+ * "the pattern has been matched up to here".  Exp_StringMatch2 tries
+ * each way a '*' can be split by recursing, which goes exponential on
+ * patterns with several stars and, restarted at every offset of the
+ * string, quadratic even on simple ones.  exp_glob_exec instead
+ * carries the set of live states along the string, so each char of
+ * the string is looked at once per state no matter how many stars
+ * the pattern has or how many offsets are tried.
+ */
+
+#define GLOB_FAIL	0	/* can never be passed */
+#define GLOB_END	1	/* end of pattern; a match */
+#define GLOB_DOLLAR	2	/* trailing '$'; a match at end of string */
+#define GLOB_STAR	3	/* '*' */
+#define GLOB_ANY	4	/* '?' */
+#define GLOB_CHAR	5	/* a plain or backslashed char */
+#define GLOB_CLASS	6	/* '[' */
+
+struct exp_glob_node {
+    int type;			/* GLOB_XXX */
+    char c;			/* GLOB_CHAR: the char to match */
+    int next;			/* state after this one is passed */
+    int *class;			/* GLOB_CLASS: state after each char, */
+				/* or -1 if the char isn't in the class */
+};
+
+struct exp_glob {
+    int anchored;		/* only try at the beginning of string */
+    int nodes;			/* one per pattern char, plus the end */
+    struct exp_glob_node *node;
+    char lit[64];		/* plain chars the pattern begins with */
+    int litlen;
+    int stamp;			/* marks states already in a list */
+    int *mark;
+    int *state[2];		/* the live states, ... */
+    int *from[2];		/* ... and where their match began */
+};
+
 /*
  *----------------------------------------------------------------------
  *
- * Exp_StringMatch --
+ * exp_glob_class --
  *
- *	Implement expect's glob-style string matching.
- *	Exp_StringMatch allow's implements the unanchored front
- *	(or conversely the '^') feature.  Exp_StringMatch2 does
- *	the rest of the work.
+ *	Decide what a "[" at pattern[p-1] does with char c, exactly
+ *	the way Exp_StringMatch2 does it (including its treatment of
+ *	malformed classes).
  *
  * Results:
- *	Number of characters that matched
+ *	Offset of the pattern char following the class, or -1 if c
+ *	doesn't match.
  *
  * Side Effects:
  *	None
@@ -36,51 +77,477 @@ would appreciate credit if this program or parts of it are used.
  *----------------------------------------------------------------------
  */
 
-int
-Exp_StringMatch(string, pattern,offset)
-    char *string;
+static int
+exp_glob_class(pattern,p,c)
     char *pattern;
-    int *offset;		/* offset from beginning of string where
-				 * pattern matches */
+    int p;
+    char c;
 {
-    char *s;
-    int sm;			/* count of chars matched or -1 */
-    int caret = FALSE;
-    int star = FALSE;
+    char c2;
 
-    *offset = 0;
+    while (1) {
+	if ((pattern[p] == ']') || (pattern[p] == 0)) return -1;
+	if (pattern[p] == c) break;
+	if (pattern[p+1] == '-') {
+	    c2 = pattern[p+2];
+	    if (c2 == 0) return -1;
+	    if ((pattern[p] <= c) && (c2 >= c)) break;
+	    if ((pattern[p] >= c) && (c2 <= c)) break;
+	    p += 2;
+	}
+	p += 1;
+    }
+    while (pattern[p] != ']') {
+	/* an unterminated class ends the pattern */
+	if (pattern[p] == 0) return p;
+	p += 1;
+    }
+    return p+1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_node --
+ *
+ *	Fill in the state for pattern position p.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	g->node[p] is set.  Classes get a table of ckalloc'd memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_glob_node(g,pattern,p)
+    struct exp_glob *g;
+    char *pattern;
+    int p;
+{
+    struct exp_glob_node *n = &g->node[p];
+    int c;
+
+    n->next = p+1;
+    switch (pattern[p]) {
+    case '\0':
+	n->type = GLOB_END;
+	break;
+    case '$':
+	if (pattern[p+1] == 0) {
+	    n->type = GLOB_DOLLAR;
+	} else {
+	    n->type = GLOB_CHAR;
+	    n->c = '$';
+	}
+	break;
+    case '*':
+	n->type = GLOB_STAR;
+	break;
+    case '?':
+	n->type = GLOB_ANY;
+	break;
+    case '[':
+	n->type = GLOB_FAIL;
+	n->class = (int *)ckalloc(256*sizeof(int));
+	n->class[0] = -1;
+	for (c=1;c<256;c++) {
+	    n->class[c] = exp_glob_class(pattern,p+1,(char)c);
+	    if (n->class[c] != -1) n->type = GLOB_CLASS;
+	}
+	if (n->type == GLOB_FAIL) {
+	    ckfree((char *)n->class);
+	    n->class = 0;
+	}
+	break;
+    case '\\':
+	if (pattern[p+1] == 0) {
+	    n->type = GLOB_FAIL;
+	} else {
+	    n->type = GLOB_CHAR;
+	    n->c = pattern[p+1];
+	    n->next = p+2;
+	}
+	break;
+    default:
+	n->type = GLOB_CHAR;
+	n->c = pattern[p];
+	break;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_lead --
+ *
+ *	Copy the plain characters a glob pattern begins with (if any)
+ *	to lit, removing backslashes.  At most max-1 are copied.
+ *
+ * Results:
+ *	Number of characters copied
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+exp_glob_lead(pattern,lit,max)
+    char *pattern;
+    char *lit;
+    int max;
+{
+    int len = 0;
+
+    while (*pattern && (len < max-1)) {
+	if ((*pattern == '*') || (*pattern == '?') || (*pattern == '[')) break;
+	if ((*pattern == '$') && (pattern[1] == 0)) break;
+	if (*pattern == '\\') {
+	    if (pattern[1] == 0) break;
+	    pattern++;
+	}
+	lit[len++] = *pattern++;
+    }
+    lit[len] = '\0';
+    return len;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_compile --
+ *
+ *	Compile an expect glob pattern for use by exp_glob_exec.
+ *
+ * Results:
+ *	The compiled pattern.  Free it with exp_glob_free.
+ *
+ * Side Effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
 
+struct exp_glob *
+exp_glob_compile(pattern)
+    char *pattern;
+{
+    struct exp_glob *g;
+    struct exp_glob_node *n;
+    int *todo;
+    int ntodo = 0;
+    int i, c;
+
+    g = (struct exp_glob *)ckalloc(sizeof(struct exp_glob));
+    g->anchored = FALSE;
     if (pattern[0] == '^') {
-	caret = TRUE;
+	g->anchored = TRUE;
 	pattern++;
     } else if (pattern[0] == '*') {
-	star = TRUE;
+	/* matches at the beginning if anywhere */
+	g->anchored = TRUE;
+    }
+
+    g->nodes = strlen(pattern) + 1;
+    g->node = (struct exp_glob_node *)
+		ckalloc(g->nodes * sizeof(struct exp_glob_node));
+    g->mark = (int *)ckalloc(5 * g->nodes * sizeof(int));
+    g->state[0] = g->mark + g->nodes;
+    g->state[1] = g->state[0] + g->nodes;
+    g->from[0] = g->state[1] + g->nodes;
+    g->from[1] = g->from[0] + g->nodes;
+    for (i=0;i<g->nodes;i++) {
+	g->node[i].type = GLOB_FAIL;
+	g->node[i].class = 0;
+	g->mark[i] = 0;
     }
+    g->stamp = 0;
 
     /*
-     * test if pattern matches in initial position.
-     * This handles front-anchor and 1st iteration of non-front-anchor.
-     * Note that 1st iteration must be tried even if string is empty.
+     * Only compile the positions a match can reach; chars inside a
+     * class or after a backslash aren't states of their own.
      */
+    todo = g->state[0];
+    g->mark[0] = 1;
+    todo[ntodo++] = 0;
+    while (ntodo > 0) {
+	i = todo[--ntodo];
+	exp_glob_node(g,pattern,i);
+	n = &g->node[i];
+	for (c=0;c<256;c++) {
+	    int next;
+
+	    if (n->type == GLOB_CLASS) next = n->class[c];
+	    else if ((n->type == GLOB_STAR) || (n->type == GLOB_ANY)
+		     || (n->type == GLOB_CHAR)) next = n->next;
+	    else break;
+
+	    if ((next >= 0) && !g->mark[next]) {
+		g->mark[next] = 1;
+		todo[ntodo++] = next;
+	    }
+	    if (n->type != GLOB_CLASS) break;
+	}
+    }
+    for (i=0;i<g->nodes;i++) g->mark[i] = 0;
+
+    g->litlen = 0;
+    if (!g->anchored) {
+	g->litlen = exp_glob_lead(pattern,g->lit,sizeof(g->lit));
+    }
+    return g;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_free --
+ *
+ *	Free a pattern compiled by exp_glob_compile.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_glob_free(g)
+    struct exp_glob *g;
+{
+    int i;
+
+    for (i=0;i<g->nodes;i++) {
+	if (g->node[i].class) ckfree((char *)g->node[i].class);
+    }
+    ckfree((char *)g->node);
+    ckfree((char *)g->mark);
+    ckfree((char *)g);
+}
+
+/*
+ * Add state n (and, if it is a '*', the states it can be skipped to)
+ * to a list of live states, on behalf of a match that began at from.
+ * The lists are kept ordered by where the match began, so a state
+ * already in the list belongs to an earlier beginning and wins.
+ */
+
+static int
+exp_glob_add(g,state,from,count,n,start)
+    struct exp_glob *g;
+    int *state;
+    int *from;
+    int count;
+    int n;
+    int start;
+{
+    while (g->mark[n] != g->stamp) {
+	g->mark[n] = g->stamp;
+	if (g->node[n].type == GLOB_FAIL) break;
+	state[count] = n;
+	from[count] = start;
+	count++;
+	if (g->node[n].type != GLOB_STAR) break;
+	n = g->node[n].next;
+    }
+    return count;
+}
+
+static void
+exp_glob_newstamp(g)
+    struct exp_glob *g;
+{
+    int i;
+
+    if (++g->stamp <= 0) {
+	for (i=0;i<g->nodes;i++) g->mark[i] = 0;
+	g->stamp = 1;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_exec --
+ *
+ *	Find the first match of a compiled glob pattern in string,
+ *	trying offsets from start onward.  Of the matches beginning
+ *	there, the longest is reported, which is what the greedy '*'
+ *	of Exp_StringMatch2 produces.  Time taken is linear in the
+ *	length of string.
+ *
+ *	Expect only ever appends to its buffers, so a position where
+ *	the pattern has already been ruled out stays ruled out; the
+ *	caller may pass *resume back as start on the next search of
+ *	the same (grown) buffer.
+ *
+ * Results:
+ *	Number of characters that matched or -1.  *offset is set to
+ *	where the match begins.  *resume is set to the first position
+ *	at which the pattern matched or could still match once more
+ *	chars are appended; it never exceeds the length of string.
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_glob_exec(g,string,start,offset,resume)
+    struct exp_glob *g;
+    char *string;
+    int start;			/* offset at which to begin trying */
+    int *offset;		/* offset from beginning of string where
+				 * pattern matches */
+    int *resume;		/* offset before which no match can begin */
+{
+    int *cur = g->state[0], *curfrom = g->from[0];
+    int *nxt = g->state[1], *nxtfrom = g->from[1];
+    int ncur = 0, nnxt;
+    int best = -1;		/* where the match found so far begins */
+    int bestend = 0;		/* and where it ends */
+    int len = -1;		/* strlen(string) once it's needed */
+    int i, k, *tmp;
+    char c;
+
+    *offset = 0;
+    *resume = start;
+
+    /* anchored patterns are only ever tried at the beginning */
+    if (g->anchored && (start > 0)) return -1;
+
+    exp_glob_newstamp(g);
+    for (i=start;;i++) {
+	if (ncur == 0) {
+	    if (best >= 0) break;
+	    if (g->anchored && (i > 0)) break;
+
+	    /*
+	     * If the pattern begins with plain chars, a match can only
+	     * begin where they occur, so let exp_memmem find the next
+	     * place worth starting.
+	     */
+	    if (g->litlen > 0) {
+		char *p;
+
+		if (len < 0) len = i + strlen(string+i);
+		p = exp_memmem(string+i,len-i,g->lit,g->litlen);
+		if (!p) {
+		    /* only the last litlen-1 positions could still begin */
+		    *resume = len - g->litlen + 1;
+		    if (*resume < i) *resume = i;
+		    return -1;
+		}
+		i = p - string;
+	    }
+	}
+	c = string[i];
+
+	/*
+	 * A match may begin here unless an earlier one was found.  As
+	 * always, that's the beginning of string (even if empty) or any
+	 * position before the terminating null.
+	 */
+	if ((best < 0) && ((i == 0) || (!g->anchored && (c != 0)))) {
+	    ncur = exp_glob_add(g,cur,curfrom,ncur,0,i);
+	}
 
-    sm = Exp_StringMatch2(string,pattern);
-    if (sm >= 0) return(sm);
+	/* the list is ordered, so the first match found begins earliest */
+	for (k=0;k<ncur;k++) {
+	    int type = g->node[cur[k]].type;
 
-    if (caret) return -1;
-    if (star) return -1;
+	    if ((type == GLOB_END) || ((type == GLOB_DOLLAR) && (c == 0))) {
+		if ((best < 0) || (curfrom[k] < best)
+		    || ((curfrom[k] == best) && (i > bestend))) {
+		    best = curfrom[k];
+		    bestend = i;
+		}
+		break;
+	    }
+	}
+	if (c == 0) break;
+
+	/* step every live state over c */
+	exp_glob_newstamp(g);
+	nnxt = 0;
+	for (k=0;k<ncur;k++) {
+	    struct exp_glob_node *n = &g->node[cur[k]];
+	    int next;
 
-    if (*string == '\0') return -1;
+	    /* matches beginning after the best one can't beat it */
+	    if ((best >= 0) && (curfrom[k] > best)) break;
 
-    for (s = string+1;*s;s++) {
-	sm = Exp_StringMatch2(s,pattern);
-	if (sm != -1) {
-	    *offset = s-string;
-	    return(sm);
+	    switch (n->type) {
+	    case GLOB_STAR:  next = cur[k]; break;
+	    case GLOB_ANY:   next = n->next; break;
+	    case GLOB_CHAR:  next = (c == n->c) ? n->next : -1; break;
+	    case GLOB_CLASS: next = n->class[(unsigned char)c]; break;
+	    default:	     next = -1; break;
+	    }
+	    if (next >= 0) {
+		nnxt = exp_glob_add(g,nxt,nxtfrom,nnxt,next,curfrom[k]);
+	    }
 	}
+	tmp = cur; cur = nxt; nxt = tmp;
+	tmp = curfrom; curfrom = nxtfrom; nxtfrom = tmp;
+	ncur = nnxt;
+    }
+
+    if (best >= 0) {
+	*offset = best;
+	*resume = best;
+	if ((ncur > 0) && (curfrom[0] < best)) *resume = curfrom[0];
+	return bestend - best;
     }
+    *resume = (ncur > 0) ? curfrom[0] : i;
     return -1;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_StringMatch --
+ *
+ *	Implement expect's glob-style string matching.
+ *	Exp_StringMatch allow's implements the unanchored front
+ *	(or conversely the '^') feature.  Callers that match the
+ *	same pattern repeatedly should compile it once with
+ *	exp_glob_compile and use exp_glob_exec instead.
+ *
+ * Results:
+ *	Number of characters that matched
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Exp_StringMatch(string, pattern,offset)
+    char *string;
+    char *pattern;
+    int *offset;		/* offset from beginning of string where
+				 * pattern matches */
+{
+    struct exp_glob *g;
+    int sm;			/* count of chars matched or -1 */
+    int resume;
+
+    g = exp_glob_compile(pattern);
+    sm = exp_glob_exec(g,string,0,offset,&resume);
+    exp_glob_free(g);
+    return sm;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -257,3 +724,92 @@ Exp_StringMatch2(string,pattern)
     }
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_glob_literal --
+ *
+ *	Find the longest run of plain characters in a glob pattern.
+ *	Any string the pattern matches must contain this run, which
+ *	lets expect rule the pattern out without trying it.
+ *
+ * Results:
+ *	Length of the run (0 if there is none worth using).  The run,
+ *	with backslashes removed, is copied to lit which must have room
+ *	for strlen(pattern)+1 chars.  *prefix is set TRUE if the run
+ *	begins the pattern, in which case a match can only begin where
+ *	the run occurs.
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_glob_literal(pattern,lit,prefix)
+    char *pattern;
+    char *lit;
+    int *prefix;
+{
+    char *p;
+    char *run = 0;		/* beginning of current run */
+    int runlen = 0;
+    char *best = 0;
+    int bestlen = 0;
+    int i;
+
+    *prefix = FALSE;
+
+    p = pattern;
+    if (*p == '^') p++;
+
+    while (*p) {
+	char *atom = p;
+
+	if ((*p == '$') && (p[1] == 0)) break;
+
+	if ((*p == '*') || (*p == '?') || (*p == '[')) {
+	    if (runlen > bestlen) {
+		best = run;
+		bestlen = runlen;
+	    }
+	    run = 0;
+	    runlen = 0;
+	    if (*p++ != '[') continue;
+
+	    /*
+	     * A class ends at the first ']' unless a range runs into it,
+	     * and "[]" never matches at all.  Don't try to be clever
+	     * about either of those.
+	     */
+	    if (*p == ']') break;
+	    while (*p && (*p != ']')) p++;
+	    if ((*p == 0) || (p[-1] == '-')) break;
+	    p++;
+	    continue;
+	}
+
+	if (*p == '\\') {
+	    if (p[1] == 0) return 0;
+	    p++;
+	}
+	p++;
+	if (!run) run = atom;
+	runlen++;
+    }
+    if (runlen > bestlen) {
+	best = run;
+	bestlen = runlen;
+    }
+    if (bestlen == 0) return 0;
+
+    for (i=0,p=best;i<bestlen;i++) {
+	if (*p == '\\') p++;
+	lit[i] = *p++;
+    }
+    lit[i] = '\0';
+    *prefix = (best == pattern + (*pattern == '^'));
+    return bestlen;
+}
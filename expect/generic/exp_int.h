@@ -23,6 +23,11 @@ would appreciate credit if this program or parts of it are used.
 
 int		Exp_StringMatch();
 int		Exp_StringMatch2();
+struct exp_glob *	exp_glob_compile();
+int		exp_glob_exec();
+void		exp_glob_free();
+int		exp_glob_literal();
+char *		exp_memmem();
 void		exp_console_set _ANSI_ARGS_((void));
 
 #ifdef NO_STDLIB_H
@@ -8,10 +8,16 @@ would appreciate credit if this program or parts of it are used.
 
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* for splice(), on systems that have it */
+#endif
+
 #include "exp_port.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <errno.h>
 
 #include "tcl.h"
 #include "string.h"
@@ -76,6 +82,24 @@ struct keymap {
 	struct keymap *next;
 };
 
+/* Fixed-string keymaps of an input compiled into one trie, so that the
+cost of looking at a keystroke does not grow with the number of keys.
+Keymaps are identified by their position in the input's list, so the
+smallest position found is the one the user listed first. */
+
+#define KEYTRIE_WIDTH	128	/* input is compared 7 bits at a time */
+
+struct keytrie {
+	int count;		/* # of keymaps, also means "none" below */
+	struct keymap **km;	/* keymaps by position */
+	int states;		/* state 0 is the root */
+	int *next;		/* next[state*KEYTRIE_WIDTH+c], 0 if none */
+	int *match;		/* first keymap ending at state */
+	int *below;		/* first keymap continuing past state */
+	int *other;		/* positions of regexp and null keymaps */
+	int others;
+};
+
 struct output {
 	struct exp_i *i_list;
 	struct action *action_eof;
@@ -88,6 +112,7 @@ struct input {
 	struct action *action_eof;
 	struct action *action_timeout;
 	struct keymap *keymap;
+	struct keytrie *trie;		/* keymap, compiled */
 	int timeout_nominal;		/* timeout nominal */
 	int timeout_remaining;		/* timeout remaining */
 	struct input *next;
@@ -95,6 +120,7 @@ struct input {
 
 static void free_input();
 static void free_keymap();
+static void free_keytrie();
 static void free_output();
 static void free_action();
 static struct action *new_action();
@@ -107,12 +133,6 @@ function assigns a matching keymap if there is a match or can-match.
 A matching keymap is assigned on can-match so we know whether to echo
 or not.
 
-in_keymap is optimized (if you can call it that) towards a small
-number of key mappings, but still works well for large maps, since no
-function calls are made, and we stop as soon as there is a single-char
-mismatch, and go on to the next one.  A hash table or compiled DFA
-probably would not buy very much here for most maps.
-
 The basic idea of how this works is it does a smart sequential search.
 At each position of the input string, we attempt to match each of the
 keymaps.  If at least one matches, the first match is returned.
@@ -121,6 +141,15 @@ If there is a CANMATCH and there are more keymaps to try, we continue
 trying.  If there are no more keymaps to try, we stop trying and
 return with an indication of the first keymap that can match.
 
+Fixed strings are not tried one at a time.  They are all looked up at
+once by walking the input's keytrie, which costs one step per
+character no matter how many keys there are.  A map of hundreds of
+terminal escape sequences is not unusual.  The walk remembers the
+first key (in the order given by the user) that ends along the way,
+and the first key that continues past the point where the input runs
+out.  Only regexp and null keymaps listed ahead of that key still
+have to be tried individually.
+
 Note that I've hacked up the regexp pattern matcher in two ways.  One
 is to force the pattern to always be anchored at the front.  That way,
 it doesn't waste time attempting to match later in the string (before
@@ -129,17 +158,17 @@ we're ready).  The other is to return can-match.
 */
 
 static int
-in_keymap(string,stringlen,keymap,km_match,match_length,skip,rm_nulls)
+in_keymap(string,stringlen,keymap,trie,km_match,match_length,skip,rm_nulls)
 char *string;
 int stringlen;
 struct keymap *keymap;		/* linked list of keymaps */
+struct keytrie *trie;		/* same, compiled */
 struct keymap **km_match;	/* keymap that matches or can match */
 int *match_length;		/* # of chars that matched */
 int *skip;			/* # of chars to skip */
 int rm_nulls;			/* skip nulls if true */
 {
 	struct keymap *km;
-	char *ks;		/* string from a keymap */
 	char *start_search;	/* where in the string to start searching */
 	char *string_end;
 
@@ -161,12 +190,50 @@ int rm_nulls;			/* skip nulls if true */
 /* skip over nulls - Pascal Meheut, pascal@cnam.cnam.fr 18-May-1993 */
 /*    for (start_search = string;*start_search;start_search++) {*/
     for (start_search = string;start_search<string_end;start_search++) {
+	char *s;	/* current character being examined */
+	int state;	/* current state of trie */
+	int next;
+	int best;	/* first fixed string that matches here */
+	int best_length;
+	int can;	/* first keymap that can match here */
+	int i;
+
 	if (*km_match) break; /* if we've already found a CANMATCH */
 			/* don't bother starting search from positions */
 			/* further along the string */
 
-	for (km=keymap;km;km=km->next) {
-	    char *s;	/* current character being examined */
+	/* fixed strings */
+	best = can = trie->count;
+	best_length = 0;
+	for (s = start_search,state = 0;;) {
+		if (trie->match[state] < best) {
+			best = trie->match[state];
+			best_length = s-start_search;
+		}
+
+		/* no longer key can be ahead of the one that matched */
+		if (trie->below[state] >= best) break;
+
+		/* if we ran out of user-supplied characters, and */
+		/* still haven't matched, it might match if the user */
+		/* supplies more characters next time */
+		if (s == string_end) {
+			can = trie->below[state];
+			break;
+		}
+
+		next = trie->next[state*KEYTRIE_WIDTH + (*s & 0x7f)];
+		if (next) {
+			state = next;
+			s++;
+		} else if ((*s == '\0') && rm_nulls) {
+			s++;
+		} else break;
+	}
+
+	/* regexps and nulls, as far as the first fixed string match */
+	for (i=0;i<trie->others && trie->other[i]<best;i++) {
+	    km = trie->km[trie->other[i]];
 
 	    if (km->null) {
 		if (*start_search == 0) {
@@ -175,35 +242,6 @@ int rm_nulls;			/* skip nulls if true */
 		    *km_match = km;
 		    return(EXP_MATCH);
 	        }
-	    } else if (!km->re) {
-		/* fixed string */
-		for (s = start_search,ks = km->keys ;;s++,ks++) {
-			/* if we hit the end of this map, must've matched! */
-			if (*ks == 0) {
-				*skip = start_search-string;
-				*match_length = s-start_search;
-				*km_match = km;
-				return(EXP_MATCH);
-			}
-
-			/* if we ran out of user-supplied characters, and */
-			/* still haven't matched, it might match if the user */
-			/* supplies more characters next time */
-
-			if (s == string_end) {
-				/* skip to next key entry, but remember */
-				/* possibility that this entry might match */
-				if (!*km_match) *km_match = km;
-				break;
-			}
-
-			if ((*s & 0x7f) == *ks) continue;
-			if ((*s == '\0') && rm_nulls) {
-				ks--;
-				continue;
-			}
-			break;
-		}
 	    } else {
 		/* regexp */
 		int r;	/* regtry status */
@@ -225,10 +263,18 @@ int rm_nulls;			/* skip nulls if true */
 			return(EXP_MATCH);
 		}
 		if (r == EXP_CANMATCH) {
-			if (!*km_match) *km_match = km;
+			if (trie->other[i] < can) can = trie->other[i];
 		}
 	    }
 	}
+
+	if (best < trie->count) {
+		*skip = start_search-string;
+		*match_length = best_length;
+		*km_match = trie->km[best];
+		return(EXP_MATCH);
+	}
+	if (can < trie->count) *km_match = trie->km[can];
     }
 
 	if (*km_match) {
@@ -264,6 +310,71 @@ int rm_nulls;			/* skip nulls if true */
 	return(EXP_CANTMATCH);
 }
 
+/* compile the fixed strings of a keymap list into a keytrie */
+static struct keytrie *
+keytrie_compile(keymap)
+struct keymap *keymap;
+{
+	struct keytrie *trie = new(struct keytrie);
+	struct keymap *km;
+	int states_max = 1;
+	int pos;
+
+	trie->count = 0;
+	for (km=keymap;km;km=km->next) {
+		trie->count++;
+		if (!km->null && !km->re) states_max += strlen(km->keys);
+	}
+
+	trie->km = (struct keymap **)ckalloc((1+trie->count) * sizeof(struct keymap *));
+	trie->other = (int *)ckalloc((1+trie->count) * sizeof(int));
+	trie->others = 0;
+	trie->next = (int *)ckalloc(states_max * KEYTRIE_WIDTH * sizeof(int));
+	memset((char *)trie->next,0,states_max * KEYTRIE_WIDTH * sizeof(int));
+	trie->match = (int *)ckalloc(states_max * sizeof(int));
+	trie->below = (int *)ckalloc(states_max * sizeof(int));
+	trie->states = 1;
+	trie->match[0] = trie->below[0] = trie->count;
+
+	for (km=keymap,pos=0;km;km=km->next,pos++) {
+		unsigned char *ks;
+		int state = 0;
+
+		trie->km[pos] = km;
+		if (km->null || km->re) {
+			trie->other[trie->others++] = pos;
+			continue;
+		}
+
+		for (ks = (unsigned char *)km->keys;*ks;ks++) {
+			int *next;
+
+			if (trie->below[state] == trie->count)
+				trie->below[state] = pos;
+			/* input is masked to 7 bits, so such a key */
+			/* can get no further than this */
+			if (*ks >= KEYTRIE_WIDTH) break;
+
+			next = &trie->next[state*KEYTRIE_WIDTH + *ks];
+			if (!*next) {
+				*next = trie->states++;
+				trie->match[*next] = trie->below[*next] = trie->count;
+			}
+			state = *next;
+		}
+		if (!*ks && trie->match[state] == trie->count)
+			trie->match[state] = pos;
+	}
+
+	if (trie->states < states_max) {
+		trie->next = (int *)ckrealloc((char *)trie->next,
+				trie->states * KEYTRIE_WIDTH * sizeof(int));
+	}
+	debuglog("compiled %d keymaps into %d states\r\n",
+		trie->count,trie->states);
+	return trie;
+}
+
 #ifdef SIMPLE_EVENT
 
 /*
@@ -471,6 +582,132 @@ int flags;		/* Information about what happened. */
 	return 0;
 }
 			
+#ifndef SIMPLE_EVENT
+/* Passthrough.  When nothing is to be done with the input of a
+direction but hand it to a single output (no keymaps, logging,
+debugging or parity stripping), the characters are moved straight
+from one descriptor to the other.  Where the system has splice(),
+they go through a pipe inside the kernel.  Otherwise, or if either
+descriptor can't be spliced (ptys often can't), they go through one
+large buffer, which still saves the trip through the spawn id's
+buffer and the keymap code. */
+
+#define RELAY_SIZE	65536
+
+struct relay {
+	int pipe[2];	/* for splice, opened upon first use */
+	int splice;	/* false once splice turns out not to work */
+	char *buf;	/* otherwise data goes through here */
+};
+
+/* return the descriptor that all of inp's data goes to, or -1 if */
+/* there is not exactly one */
+static int
+relay_output(inp,outputp)
+struct input *inp;
+struct output **outputp;
+{
+	struct output *outp;
+	int od = -1;
+
+	for (outp = inp->output;outp;outp=outp->next) {
+		struct exp_fd_list *fdp = outp->i_list->fd_list;
+
+		if (!fdp) continue;
+		if (fdp->next || od != -1) return -1;
+		od = fdp->fd;
+		/* if opened by Tcl, it may use a different */
+		/* output descriptor */
+		od = (exp_fs[od].tcl_handle?exp_fs[od].tcl_output:od);
+		*outputp = outp;
+	}
+	return od;
+}
+
+/* write all n chars, returning FALSE if the descriptor fails */
+static int
+relay_write(od,buf,n)
+int od;
+char *buf;
+int n;
+{
+	int wc;
+
+	for (;n > 0;n -= wc,buf += wc) {
+		if (0 >= (wc = write(od,buf,n))) return FALSE;
+	}
+	return TRUE;
+}
+
+/* move whatever is waiting on id to od */
+/* returns # of chars moved, 0 upon eof, -1 if od fails */
+static int
+relay_move(r,id,od)
+struct relay *r;
+int id;
+int od;
+{
+	int cc;
+
+#ifdef HAVE_SPLICE
+	if (r->splice && r->pipe[0] == -1 && pipe(r->pipe) == -1) {
+		r->splice = FALSE;
+	}
+	if (r->splice) {
+		int n, wc;
+
+		cc = splice(id,NULL,r->pipe[1],NULL,RELAY_SIZE,SPLICE_F_MOVE);
+		if (cc == -1 && (errno == EINVAL || errno == ENOSYS)) {
+			debuglog("interact: splice unavailable on spawn id %d, using read\r\n",id);
+			r->splice = FALSE;
+		} else if (cc <= 0) {
+			return 0;
+		} else {
+			for (n = cc;n > 0;n -= wc) {
+				wc = splice(r->pipe[0],NULL,od,NULL,n,SPLICE_F_MOVE);
+				if (wc > 0) continue;
+				if (wc == -1 && (errno == EINVAL || errno == ENOSYS)) {
+					/* can't splice out, so drain the */
+					/* pipe the ordinary way */
+					r->splice = FALSE;
+					if (!r->buf) r->buf = ckalloc(RELAY_SIZE);
+					while (n > 0) {
+						if (0 >= (wc = read(r->pipe[0],r->buf,n))
+						 || !relay_write(od,r->buf,wc)) break;
+						n -= wc;
+					}
+					if (n == 0) return cc;
+				}
+				/* leave no stale chars behind in the pipe */
+				close(r->pipe[0]);
+				close(r->pipe[1]);
+				r->pipe[0] = r->pipe[1] = -1;
+				return -1;
+			}
+			return cc;
+		}
+	}
+#endif /* HAVE_SPLICE */
+
+	if (!r->buf) r->buf = ckalloc(RELAY_SIZE);
+	cc = read(id,r->buf,RELAY_SIZE);
+	if (cc <= 0) return 0;
+	if (!relay_write(od,r->buf,cc)) return -1;
+	return cc;
+}
+
+static void
+relay_free(r)
+struct relay *r;
+{
+	if (r->pipe[0] != -1) {
+		close(r->pipe[0]);
+		close(r->pipe[1]);
+	}
+	if (r->buf) ckfree(r->buf);
+}
+#endif /* SIMPLE_EVENT */
+
 #define finish(x)	{ status = x; goto done; }
 
 static char return_cmd[] = "return";
@@ -494,6 +731,9 @@ char **argv;
 	struct input **fd_to_input;	/* map from fd's to "struct input"s */
 	int *fd_list;
 	struct keymap *km;	/* ptr for above while parsing */
+#ifndef SIMPLE_EVENT
+	struct relay relay;	/* for passthrough */
+#endif
 /* 	extern char *tclRegexpError;	/* declared in tclInt.h */
 	int master = EXP_SPAWN_ID_BAD;
 	char *master_string = 0;/* string representation of master */
@@ -571,6 +811,7 @@ char **argv;
 	input_user->timeout_nominal = EXP_TIME_INFINITY;
 	input_user->action_timeout = 0;
 	input_user->keymap = 0;
+	input_user->trie = 0;
 
 	end_km = &input_user->keymap;
 	inp = input_user;
@@ -583,6 +824,7 @@ char **argv;
 	input_default->timeout_nominal = EXP_TIME_INFINITY;
 	input_default->action_timeout = 0;
 	input_default->keymap = 0;
+	input_default->trie = 0;
 	input_default->next = 0;		/* no one else */
 	input_user->next = input_default;
 
@@ -621,7 +863,7 @@ char **argv;
 				exp_error(interp,"timeout needs time");
 				return(TCL_ERROR);
 			}
-			t = atoi(*argv);
+			t = exp_msec_arg(*argv);
 			argc--;argv++;
 
 			/* we need an arbitrary timeout to start */
@@ -674,6 +916,7 @@ char **argv;
 				inp->timeout_nominal = default_timeout;
 				inp->action_timeout = &action_timeout;
 				inp->keymap = 0;
+				inp->trie = 0;
 				end_km = &inp->keymap;
 				inp->next = 0;
 				argc--;argv++;
@@ -813,7 +1056,7 @@ char **argv;
 					return(TCL_ERROR);
 				}
 
-				t = atoi(*argv);
+				t = exp_msec_arg(*argv);
 				argc--;argv++;
 				if (t != -1)
 					arbitrary_timeout = t;
@@ -916,6 +1159,10 @@ char **argv;
 		if (dash_input_count == 0) dash_input_count = 1;
 	}
 
+	for (inp = input_base;inp;inp=inp->next) {
+		if (inp->keymap) inp->trie = keytrie_compile(inp->keymap);
+	}
+
 	/* if the user has not supplied either "-output" for the */
 	/* default two "-input"s, fix them up here */
 
@@ -1026,6 +1273,11 @@ char **argv;
 
 	fd_list = 0;
 	fd_to_input = 0;
+#ifndef SIMPLE_EVENT
+	relay.pipe[0] = relay.pipe[1] = -1;
+	relay.splice = TRUE;
+	relay.buf = 0;
+#endif
 
 	/***************************************************************/
 	/* all data structures are sufficiently set up that we can now */
@@ -1064,14 +1316,15 @@ char **argv;
 		int m;	/* master */
 		int m_out; /* where master echoes to */
 		struct action *action = 0;
-		time_t previous_time;
-		time_t current_time;
+		long previous_time;
+		long current_time;
 		int match_length, skip;
 		int change;	/* if action requires cooked mode */
 		int attempt_match = TRUE;
 		struct input *soonest_input;
 		int print;		/* # of chars to print */
 		int oldprinted;		/* old version of u->printed */
+		int od;			/* passthrough output descriptor */
 
 		int timeout;	/* current as opposed to default_timeout */
 
@@ -1090,7 +1343,7 @@ char **argv;
 				}
 			}
 
-			time(&previous_time);
+			previous_time = exp_msec();
 			/* timestamp here rather than simply saving old */
 			/* current time (after ready()) to account for */
 			/* possibility of slow actions */
@@ -1126,7 +1379,7 @@ char **argv;
 		if (!timeout_simple) {
 			int time_diff;
 
-			time(&current_time);
+			current_time = exp_msec();
 			time_diff = current_time - previous_time;
 
 			/* update all timers */
@@ -1163,21 +1416,34 @@ char **argv;
 			    debuglog("Recommend you enlarge the buffer or fix your patterns.\r\n");
 			    exp_buffer_shuffle(interp,u,0,INTER_OUT,"interact");
 		        }
-			cc = read(m,	u->buffer + u->size,
+
+			/* nothing to match, log or strip - just pass it on */
+			if (!inp->keymap && u->size == 0 && u->parity
+			    && !logfile && !u->log && !debugfile && !is_debugging
+			    && -1 != (od = relay_output(inp,&outp))) {
+				cc = relay_move(&relay,m,od);
+				if (cc > 0) {
+					u->stats.reads++;
+					u->stats.read_bytes += cc;
+					continue;
+				}
+				if (cc < 0) {
+					debuglog("interact: write on spawn id %d failed (%s)\r\n",outp->i_list->fd_list->fd,Tcl_PosixError(interp));
+					action = outp->action_eof;
+					goto got_action;
+				}
+			} else cc = read(m,	u->buffer + u->size,
 					u->msize - u->size);
 			if (cc > 0) {
 				u->key = key;
+				u->stats.reads++;
+				u->stats.read_bytes += cc;
 				u->size += cc;
 				u->buffer[u->size] = '\0';
 
 				/* strip parity if requested */
 				if (u->parity == 0) {
-					/* do it from end backwards */
-					char *p = u->buffer + u->size - 1;
-					int count = cc;
-					while (count--) {
-						*p-- &= 0x7f;
-					}
+					exp_condition(u->buffer + u->size - cc,cc,TRUE);
 				}
 
 				/* avoid another function call if possible */
@@ -1228,7 +1494,7 @@ char **argv;
 		km = 0;
 
 		if (attempt_match) {
-			rc = in_keymap(u->buffer,u->size,inp->keymap,
+			rc = in_keymap(u->buffer,u->size,inp->keymap,inp->trie,
 				&km,&match_length,&skip,u->rm_nulls);
 		} else {
 			attempt_match = TRUE;
@@ -1317,6 +1583,12 @@ char **argv;
 		/* buffers directly. */
 		if (print > u->printed) {	/* usual case */
 			int wc;	/* return code from write() */
+
+			/* log_file -i logs all that comes from u */
+			if (u->log) {
+				exp_log_write(u->log,u->buffer+u->printed,
+					print - u->printed);
+			}
 			for (outp = inp->output;outp;outp=outp->next) {
 			    struct exp_fd_list *fdp;
 			    for (fdp = outp->i_list->fd_list;fdp;fdp=fdp->next) {
@@ -1325,8 +1597,8 @@ char **argv;
 				/* send to logfile if open */
 				/* and user is seeing it */
 				if (logfile && real_tty_output(fdp->fd)) {
-					fwrite(u->buffer+u->printed,1,
-					       print - u->printed,logfile);
+					exp_logfile_write(u->buffer+u->printed,
+						print - u->printed);
 				}
 
 				/* send to each output descriptor */
@@ -1383,29 +1655,16 @@ char **argv;
 			action = &km->action;
 
 			skip += match_length;
-			u->size -= skip;
-
-			if (u->size) {
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-			}
-		} else {
-			if (skip) {
-				u->size -= skip;
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-			}
 		}
+		exp_buffer_discard(u,skip);
 
 #if EOF_SO
 		/* as long as buffer is still around, null terminate it */
 		if (rc != EXP_EOF) {
 			u->buffer[u->size] = '\0';
-			u->lower [u->size] = '\0';
 		}
 #else
 		u->buffer[u->size] = '\0';
-		u->lower [u->size] = '\0';
 #endif
 
 		/* now update printed based on total amount skipped */
@@ -1469,8 +1728,8 @@ got_action:
 		int cc;	/* chars count from read() */
 		int m;	/* master */
 		struct action *action = 0;
-		time_t previous_time;
-		time_t current_time;
+		long previous_time;
+		long current_time;
 		int match_length, skip;
 		int change;	/* if action requires cooked mode */
 		int attempt_match = TRUE;
@@ -1506,7 +1765,7 @@ got_action:
 					timeout = inp->timeout_remaining;
 			}
 
-			time(&previous_time);
+			previous_time = exp_msec();
 			/* timestamp here rather than simply saving old */
 			/* current time (after ready()) to account for */
 			/* possibility of slow actions */
@@ -1521,7 +1780,7 @@ got_action:
 		if (!timeout_simple) {
 			int time_diff;
 
-			time(&current_time);
+			current_time = exp_msec();
 			time_diff = current_time - previous_time;
 
 			/* update all timers */
@@ -1548,17 +1807,14 @@ got_action:
 					u->msize - u->size);
 			if (cc > 0) {
 				u->key = key;
+				u->stats.reads++;
+				u->stats.read_bytes += cc;
 				u->size += cc;
 				u->buffer[u->size] = '\0';
 
 				/* strip parity if requested */
 				if (u->parity == 0) {
-					/* do it from end backwards */
-					char *p = u->buffer + u->size - 1;
-					int count = cc;
-					while (count--) {
-						*p-- &= 0x7f;
-					}
+					exp_condition(u->buffer + u->size - cc,cc,TRUE);
 				}
 
 				/* avoid another function call if possible */
@@ -1591,7 +1847,7 @@ got_action:
 		km = 0;
 
 		if (attempt_match) {
-			rc = in_keymap(u->buffer,u->size,inp->keymap,
+			rc = in_keymap(u->buffer,u->size,inp->keymap,inp->trie,
 				&km,&match_length,&skip);
 		} else {
 			attempt_match = TRUE;
@@ -1676,6 +1932,12 @@ got_action:
 		/* buffers directly. */
 		if (print > u->printed) {	/* usual case */
 			int wc;	/* return code from write() */
+
+			/* log_file -i logs all that comes from u */
+			if (u->log) {
+				exp_log_write(u->log,u->buffer+u->printed,
+					print - u->printed);
+			}
 			for (outp = inp->output;outp;outp=outp->next) {
 			    struct exp_fd_list *fdp;
 			    for (fdp = outp->i_list->fd_list;fdp;fdp=fdp->next) {
@@ -1684,8 +1946,8 @@ got_action:
 				/* send to logfile if open */
 				/* and user is seeing it */
 				if (logfile && real_tty_output(fdp->fd)) {
-					fwrite(u->buffer+u->printed,1,
-					       print - u->printed,logfile);
+					exp_logfile_write(u->buffer+u->printed,
+						print - u->printed);
 				}
 
 				/* send to each output descriptor */
@@ -1737,23 +1999,12 @@ got_action:
 			action = &km->action;
 
 			skip += match_length;
-			u->size -= skip;
-
-			if (u->size)
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-		} else {
-			if (skip) {
-				u->size -= skip;
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-			}
 		}
+		exp_buffer_discard(u,skip);
 
 		/* as long as buffer is still around, null terminate it */
 		if (rc != EXP_EOF) {
 			u->buffer[u->size] = '\0';
-			u->lower [u->size] = '\0';
 		}
 		/* now update printed based on total amount skipped */
 
@@ -1821,7 +2072,7 @@ got_action:
 					timeout = inp->timeout_remaining;
 			}
 
-			time(&previous_time);
+			previous_time = exp_msec();
 			/* timestamp here rather than simply saving old */
 			/* current time (after ready()) to account for */
 			/* possibility of slow actions */
@@ -1835,7 +2086,7 @@ got_action:
 		if (!timeout_simple) {
 			int time_diff;
 
-			time(&current_time);
+			current_time = exp_msec();
 			time_diff = current_time - previous_time;
 
 			/* update all timers */
@@ -1862,17 +2113,14 @@ got_action:
 					u->msize - u->size);
 			if (cc > 0) {
 				u->key = key;
+				u->stats.reads++;
+				u->stats.read_bytes += cc;
 				u->size += cc;
 				u->buffer[u->size] = '\0';
 
 				/* strip parity if requested */
 				if (u->parity == 0) {
-					/* do it from end backwards */
-					char *p = u->buffer + u->size - 1;
-					int count = cc;
-					while (count--) {
-						*p-- &= 0x7f;
-					}
+					exp_condition(u->buffer + u->size - cc,cc,TRUE);
 				}
 
 				/* avoid another function call if possible */
@@ -1915,7 +2163,7 @@ got_action:
 		km = 0;
 
 		if (attempt_match) {
-			rc = in_keymap(u->buffer,u->size,inp->keymap,
+			rc = in_keymap(u->buffer,u->size,inp->keymap,inp->trie,
 				&km,&match_length,&skip);
 		} else {
 			attempt_match = TRUE;
@@ -1995,6 +2243,12 @@ got_action:
 		/* buffers directly. */
 		if (print > u->printed) {	/* usual case */
 			int wc;	/* return code from write() */
+
+			/* log_file -i logs all that comes from u */
+			if (u->log) {
+				exp_log_write(u->log,u->buffer+u->printed,
+					print - u->printed);
+			}
 			for (outp = inp->output;outp;outp=outp->next) {
 			    struct exp_fd_list *fdp;
 			    for (fdp = outp->i_list->fd_list;fdp;fdp=fdp->next) {
@@ -2003,8 +2257,8 @@ got_action:
 				/* send to logfile if open */
 				/* and user is seeing it */
 				if (logfile && real_tty_output(fdp->fd)) {
-					fwrite(u->buffer+u->printed,1,
-					       print - u->printed,logfile);
+					exp_logfile_write(u->buffer+u->printed,
+						print - u->printed);
 				}
 
 				/* send to each output descriptor */
@@ -2061,23 +2315,12 @@ got_action:
 			action = &km->action;
 
 			skip += match_length;
-			u->size -= skip;
-
-			if (u->size)
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-		} else {
-			if (skip) {
-				u->size -= skip;
-				memcpy(u->buffer, u->buffer + skip, u->size);
-				exp_lowmemcpy(u->lower,u->buffer+ skip, u->size);
-			}
 		}
+		exp_buffer_discard(u,skip);
 
 		/* as long as buffer is still around, null terminate it */
 		if (rc != EXP_EOF) {
 			u->buffer[u->size] = '\0';
-			u->lower [u->size] = '\0';
 		}
 		/* now update printed based on total amount skipped */
 
@@ -2141,6 +2384,9 @@ got_action:
 	if (oldargv) ckfree((char *)argv);
 	if (fd_list) ckfree((char *)fd_list);
 	if (fd_to_input) ckfree((char *)fd_to_input);
+#ifndef SIMPLE_EVENT
+	relay_free(&relay);
+#endif
 	free_input(interp,input_base);
 	free_action(action_base);
 
@@ -2190,6 +2436,20 @@ struct keymap *km;
 	ckfree((char *)km);
 }
 
+static void
+free_keytrie(trie)
+struct keytrie *trie;
+{
+	if (trie == 0) return;
+
+	ckfree((char *)trie->km);
+	ckfree((char *)trie->other);
+	ckfree((char *)trie->next);
+	ckfree((char *)trie->match);
+	ckfree((char *)trie->below);
+	ckfree((char *)trie);
+}
+
 static void
 free_action(a)
 struct action *a;
@@ -2214,6 +2474,7 @@ struct input *i;
 	exp_free_i(interp,i->i_list,inter_updateproc);
 	free_output(interp,i->output);
 	free_keymap(i->keymap);
+	free_keytrie(i->trie);
 	ckfree((char *)i);
 }
 
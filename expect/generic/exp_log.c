@@ -96,7 +96,7 @@ exp_log TCL_VARARGS_DEF(int,arg1)
     }
 
     if (debugfile) Tcl_Write(debugfile, buf, n);
-    if (logfile_all || (LOGUSER && logfile)) Tcl_Write(logfile, buf, n);
+    if (logfile_all || (LOGUSER && logfile)) exp_logfile_write(buf, n);
     if (LOGUSER) {
 	chan = Tcl_GetStdChannel(TCL_STDOUT);
 	if (chan) {
@@ -136,7 +136,7 @@ exp_nflog(buf,force_stdout)
     Tcl_Channel chan;
     
     if (debugfile) Tcl_Write(debugfile, buf, len);
-    if (logfile_all || (LOGUSER && logfile)) Tcl_Write(logfile, buf, len);
+    if (logfile_all || (LOGUSER && logfile)) exp_logfile_write(buf, len);
     if (LOGUSER) {
 	chan = Tcl_GetStdChannel(TCL_STDOUT);
 	if (chan) {
@@ -146,6 +146,36 @@ exp_nflog(buf,force_stdout)
 }
 #undef LOGUSER
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * debuglog_write --
+ *
+ *	Write n chars of buf wherever debuglog output goes.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+debuglog_write(buf,n)
+    char *buf;
+    int n;
+{
+    Tcl_Channel chan;
+
+    if (debugfile) Tcl_Write(debugfile, buf, n);
+    if (is_debugging) {
+	chan = Tcl_GetStdChannel(TCL_STDERR);
+	if (chan) {
+	    Tcl_Write(chan, buf, n);
+	}
+	if (logfile) exp_logfile_write(buf, n);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -162,7 +192,7 @@ exp_nflog(buf,force_stdout)
  *	Messages may be written to a logfile
  *
  * Notes:
- *	Static buffer is used, so overflow can be in issue
+ *	Nothing is formatted unless it will be written somewhere.
  *
  *----------------------------------------------------------------------
  */
@@ -176,34 +206,79 @@ exp_debuglog TCL_VARARGS_DEF(char *,arg1)
     char *p = buf;
     int len = sizeof(buf);
     int n;
-    Tcl_Channel chan;
     va_list args;
 
-    fmt = TCL_VARARGS_START(char *,arg1,args);
+    if (!EXP_DEBUGGING) return;
 
-    n = -1;
-    while (n == -1) {
+    for (;;) {
+	fmt = TCL_VARARGS_START(char *,arg1,args);
 	n = vsnprintf(p, len, fmt, args);
-	if (n == -1) {
-	    if (p != buf) {
-		free(p);
-	    }
-	    len *= 2;
-	    p = malloc(len);
-	}
+	va_end(args);
+	if (n >= 0 && n < len) break;
+	/* too small; n is the size needed, or -1 if unknown */
+	len = (n >= 0) ? n + 1 : len * 2;
+	if (p != buf) free(p);
+	p = malloc(len);
     }
 
-    if (debugfile) Tcl_Write(debugfile, buf, n);
-    if (is_debugging) {
-	chan = Tcl_GetStdChannel(TCL_STDERR);
-	if (chan) {
-	    Tcl_Write(chan, buf, n);
+    debuglog_write(p, n);
+    if (p != buf) free(p);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_debuglog_printify --
+ *
+ *	Like debuglog("%s",exp_printify(s)), but s is escaped a piece
+ *	at a time straight to the debug output, so no copy of it is
+ *	made however large it is.  length chars are written (nulls
+ *	included), or if length is -1, s is null-terminated.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Messages may be written to a logfile
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_debuglog_printify(s,length)
+    char *s;
+    int length;
+{
+    char out[1024];
+    int n = 0;
+
+    if (!EXP_DEBUGGING) return;
+
+    if (s == 0) {
+	debuglog_write("<null>",6);
+	return;
+    }
+    if (length < 0) length = strlen(s);
+
+    for (;length > 0;length--,s++) {
+	if (n > sizeof(out) - 5) {
+	    debuglog_write(out,n);
+	    n = 0;
+	}
+	if (*s == '\r') {
+	    out[n++] = '\\'; out[n++] = 'r';
+	} else if (*s == '\n') {
+	    out[n++] = '\\'; out[n++] = 'n';
+	} else if (*s == '\t') {
+	    out[n++] = '\\'; out[n++] = 't';
+	} else if (isascii(*s) && isprint(*s)) {
+	    out[n++] = *s;
+	} else {
+	    sprintf(out+n,"\\x%02x",*s & 0xff);
+	    n += 4;
 	}
-	if (logfile) Tcl_Write(logfile, buf, n);
     }
-    
-    if (p != buf) free(p);
-    va_end(args);
+    if (n) debuglog_write(out,n);
 }
 
 /*
@@ -255,7 +330,7 @@ exp_errorlog TCL_VARARGS_DEF(char *,arg1)
 	Tcl_Write(chan, buf, n);
     }
     if (debugfile) Tcl_Write(debugfile, buf, n);
-    if (logfile) Tcl_Write(logfile, buf, n);
+    if (logfile) exp_logfile_write(buf, n);
     if (p != buf) free(p);
     va_end(args);
 }
@@ -290,7 +365,7 @@ exp_nferrorlog(buf,force_stdout)
 	Tcl_Write(chan, buf, len);
     }
     if (debugfile) Tcl_Write(debugfile, buf, len);
-    if (logfile) Tcl_Write(logfile, buf, len);
+    if (logfile) exp_logfile_write(buf, len);
 }
 
 #if 0
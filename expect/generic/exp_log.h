@@ -9,17 +9,25 @@
 			  if (debugfile) fwrite(buf,1,length,debugfile); \
 			  }
 
-#define dprintify(x)	((is_debugging || debugfile)?exp_printify(x):0)
+/* true if debuglog would write anywhere.  Test it before doing any */
+/* work whose only purpose is to build debuglog's arguments. */
+#define EXP_DEBUGGING	(exp_is_debugging || exp_debugfile)
+
+#define dprintify(x)	(EXP_DEBUGGING?exp_printify(x):0)
 /* in circumstances where "debuglog(printify(...))" is written, call */
 /* dprintify instead.  This will avoid doing any formatting that would */
 /* occur before debuglog got control and decided not to do anything */
-/* because (is_debugging || debugfile) was false. */
+/* because (is_debugging || debugfile) was false.  For strings that */
+/* may be large, such as the contents of a buffer, use */
+/* exp_debuglog_printify, which never copies the string. */
 
 extern void exp_errorlog _ANSI_ARGS_(TCL_VARARGS(char *,fmt));
 extern void exp_log _ANSI_ARGS_(TCL_VARARGS(int,force_stdout));
 extern void exp_debuglog _ANSI_ARGS_(TCL_VARARGS(char *,fmt));
 extern void exp_nflog _ANSI_ARGS_((char *buf, int force_stdout));
 extern void exp_nferrorlog _ANSI_ARGS_((char *buf, int force_stdout));
+extern void exp_logfile_write _ANSI_ARGS_((char *buf, int length));
+extern void exp_debuglog_printify _ANSI_ARGS_((char *buf, int length));
 
 #if defined(__WIN32__) && defined(__EXPECTLIBUSER__)
 #define DLLIMP __declspec(dllimport)
@@ -0,0 +1,89 @@
+/* exp_memmem.c - find a string in a buffer that may contain nulls
+
+Expect spends much of its time looking for literal strings (-ex
+patterns and the literal parts of globs) in spawn id buffers that can
+grow large when a process produces a lot of output.  Where the compiler
+supports SSE2, candidate positions are found 16 bytes at a time by
+comparing the first and last chars of the string at once; only those
+candidates are compared in full.  Otherwise memchr does the scanning.
+
+*/
+
+#include <string.h>
+
+#include "exp_port.h"
+#include "tcl.h"
+#include "exp_int.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define EXP_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_memmem --
+ *
+ *	Find the first occurrence of needle in the first hlen chars of
+ *	hay.  Unlike strstr, nulls in either are just chars.
+ *
+ * Results:
+ *	Pointer to the occurrence or NULL if there is none
+ *
+ * Side Effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+exp_memmem(hay,hlen,needle,nlen)
+    char *hay;
+    int hlen;
+    char *needle;
+    int nlen;
+{
+    char *p = hay;
+    char *last;			/* last place needle could begin */
+
+    if (nlen <= 0) return hay;
+    if (nlen > hlen) return 0;
+    last = hay + (hlen - nlen);
+
+#ifdef EXP_SSE2
+    if (nlen > 1) {
+	__m128i first_c = _mm_set1_epi8(needle[0]);
+	__m128i last_c = _mm_set1_epi8(needle[nlen-1]);
+
+	/* both 16-byte loads must stay within hay */
+	while (p + 16 <= last + 1) {
+	    __m128i a = _mm_loadu_si128((__m128i *)p);
+	    __m128i b = _mm_loadu_si128((__m128i *)(p + nlen - 1));
+	    unsigned int mask;
+
+	    mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a,first_c),
+						   _mm_cmpeq_epi8(b,last_c)));
+	    while (mask) {
+		int bit = 0;
+
+		while (!(mask & (1 << bit))) bit++;
+		if (memcmp(p + bit + 1,needle + 1,nlen - 2) == 0) {
+		    return p + bit;
+		}
+		mask &= mask - 1;
+	    }
+	    p += 16;
+	}
+    }
+#endif
+
+    while (p <= last) {
+	p = memchr(p,needle[0],(last - p) + 1);
+	if (!p) return 0;
+	if (memcmp(p,needle,nlen) == 0) return p;
+	p++;
+    }
+    return 0;
+}
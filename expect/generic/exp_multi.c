@@ -0,0 +1,446 @@
+/*
+ * exp_multi.c --
+ *
+ *	A combined matcher for the literal parts of all the patterns of
+ *	one expect command.  Every -ex string, and the longest literal
+ *	run of each glob and regexp, is compiled into an Aho-Corasick
+ *	automaton so that a single pass over a spawn id's buffer finds
+ *	every literal at once.  expect uses the result to answer -ex
+ *	cases directly and to skip glob and regexp cases that cannot
+ *	possibly match, instead of running each pattern over the whole
+ *	buffer in turn.
+ *
+ *	Case-sensitive and -nocase literals live in separate automata.
+ *	The -nocase one folds input chars through its character map, so
+ *	it can run over the original buffer rather than the lowercased
+ *	copy.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include <string.h>
+#include <ctype.h>
+
+#include "exp_port.h"
+#include "tcl.h"
+#include "exp_int.h"
+#include "exp_multi.h"
+
+struct exp_lit {
+    char *str;			/* literal text (folded if fold) */
+    int len;
+    int fold;			/* if matched without regard to case */
+    int same;			/* next literal with identical text, or -1 */
+};
+
+struct exp_ac {			/* one Aho-Corasick automaton */
+    int nclass;			/* # of distinct char classes */
+    unsigned char map[256];	/* input char -> class */
+    int nstates;
+    int *delta;			/* nstates x nclass transition table */
+    int *out;			/* per state: literal ending here, or -1 */
+    int *dict;			/* per state: nearest state on the failure */
+				/* chain that ends a literal, or -1 */
+};
+
+struct exp_multi {
+    int nlit;			/* # of literals */
+    int alit;			/* # of literals allocated */
+    struct exp_lit *lits;
+    struct exp_ac *ac[2];	/* [0] case-sensitive, [1] folded */
+    int compiled;
+    Tcl_HashTable scans;	/* buffer key -> struct exp_multi_scan */
+};
+
+#define EXP_FOLD(c)	((isascii(c) && isupper(c))?tolower(c):(c))
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_new --
+ *
+ *	Create an empty combined matcher
+ *
+ * Results:
+ *	The new matcher
+ *
+ *----------------------------------------------------------------------
+ */
+
+struct exp_multi *
+exp_multi_new()
+{
+    struct exp_multi *m;
+
+    m = (struct exp_multi *) ckalloc(sizeof(struct exp_multi));
+    m->nlit = 0;
+    m->alit = 0;
+    m->lits = 0;
+    m->ac[0] = m->ac[1] = 0;
+    m->compiled = FALSE;
+    Tcl_InitHashTable(&m->scans, TCL_ONE_WORD_KEYS);
+    return m;
+}
+
+static void
+exp_ac_free(ac)
+    struct exp_ac *ac;
+{
+    if (!ac) return;
+    ckfree((char *) ac->delta);
+    ckfree((char *) ac->out);
+    ckfree((char *) ac->dict);
+    ckfree((char *) ac);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_free --
+ *
+ *	Release a combined matcher and everything it has remembered
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_multi_free(m)
+    struct exp_multi *m;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    int i;
+
+    for (hPtr = Tcl_FirstHashEntry(&m->scans, &search); hPtr;
+	 hPtr = Tcl_NextHashEntry(&search)) {
+	ckfree((char *) Tcl_GetHashValue(hPtr));
+    }
+    Tcl_DeleteHashTable(&m->scans);
+
+    for (i=0;i<m->nlit;i++) {
+	ckfree(m->lits[i].str);
+    }
+    if (m->lits) ckfree((char *) m->lits);
+    exp_ac_free(m->ac[0]);
+    exp_ac_free(m->ac[1]);
+    ckfree((char *) m);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_add --
+ *
+ *	Add a literal to the matcher.  Must be called before
+ *	exp_multi_compile.
+ *
+ * Results:
+ *	The id of the literal (used to index the first/last arrays of
+ *	a scan), or -1 if the literal is empty.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_multi_add(m,str,len,fold)
+    struct exp_multi *m;
+    char *str;
+    int len;
+    int fold;			/* match without regard to case */
+{
+    struct exp_lit *l;
+    int i;
+
+    if (len <= 0 || m->compiled) return -1;
+
+    if (m->nlit == m->alit) {
+	m->alit = m->alit ? 2*m->alit : 8;
+	m->lits = (struct exp_lit *) ckrealloc((char *) m->lits,
+				m->alit * sizeof(struct exp_lit));
+    }
+    l = &m->lits[m->nlit];
+    l->str = ckalloc(len + 1);
+    for (i=0;i<len;i++) {
+	l->str[i] = fold ? EXP_FOLD(str[i]) : str[i];
+    }
+    l->str[len] = '\0';
+    l->len = len;
+    l->fold = fold;
+    l->same = -1;
+    return m->nlit++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_count --
+ *
+ *	Number of literals in the matcher
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_multi_count(m)
+    struct exp_multi *m;
+{
+    return m->nlit;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_ac_build --
+ *
+ *	Build the automaton for all literals whose fold flag matches.
+ *	The trie is built directly in the transition table; the
+ *	breadth-first pass then fills in the missing transitions from
+ *	the failure links so that scanning never has to backtrack.
+ *
+ * Results:
+ *	The automaton, or NULL if there are no such literals
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct exp_ac *
+exp_ac_build(m,fold)
+    struct exp_multi *m;
+    int fold;
+{
+    struct exp_ac *ac;
+    int i, j, c, s, nc;
+    int maxstates = 1;
+    int *fail, *queue;
+    int head, tail;
+
+    for (i=0;i<m->nlit;i++) {
+	if (m->lits[i].fold == fold) maxstates += m->lits[i].len;
+    }
+    if (maxstates == 1) return 0;
+
+    ac = (struct exp_ac *) ckalloc(sizeof(struct exp_ac));
+
+    /* only chars that occur in some literal need their own class */
+    memset(ac->map, 0, sizeof(ac->map));
+    nc = 1;
+    for (i=0;i<m->nlit;i++) {
+	if (m->lits[i].fold != fold) continue;
+	for (j=0;j<m->lits[i].len;j++) {
+	    c = (unsigned char) m->lits[i].str[j];
+	    if (!ac->map[c]) ac->map[c] = nc++;
+	}
+    }
+    if (fold) {
+	for (c=0;c<256;c++) ac->map[c] = ac->map[EXP_FOLD(c)];
+    }
+    ac->nclass = nc;
+
+    ac->delta = (int *) ckalloc(maxstates * nc * sizeof(int));
+    ac->out = (int *) ckalloc(maxstates * sizeof(int));
+    ac->dict = (int *) ckalloc(maxstates * sizeof(int));
+    for (i=0;i<maxstates*nc;i++) ac->delta[i] = -1;
+    for (i=0;i<maxstates;i++) ac->out[i] = ac->dict[i] = -1;
+    ac->nstates = 1;
+
+    /* build the trie */
+    for (i=0;i<m->nlit;i++) {
+	struct exp_lit *l = &m->lits[i];
+
+	if (l->fold != fold) continue;
+	s = 0;
+	for (j=0;j<l->len;j++) {
+	    int *t = &ac->delta[s*nc + ac->map[(unsigned char) l->str[j]]];
+	    if (*t < 0) *t = ac->nstates++;
+	    s = *t;
+	}
+	if (ac->out[s] >= 0) {
+	    /* duplicate literal, chain it to the first */
+	    l->same = m->lits[ac->out[s]].same;
+	    m->lits[ac->out[s]].same = i;
+	} else {
+	    ac->out[s] = i;
+	}
+    }
+
+    /* compute failure links breadth first, filling in the table */
+    fail = (int *) ckalloc(ac->nstates * sizeof(int));
+    queue = (int *) ckalloc(ac->nstates * sizeof(int));
+    head = tail = 0;
+    fail[0] = 0;
+    for (c=0;c<nc;c++) {
+	s = ac->delta[c];
+	if (s < 0) {
+	    ac->delta[c] = 0;
+	} else {
+	    fail[s] = 0;
+	    queue[tail++] = s;
+	}
+    }
+    while (head < tail) {
+	int r = queue[head++];
+
+	for (c=0;c<nc;c++) {
+	    int u = ac->delta[r*nc + c];
+	    int f = ac->delta[fail[r]*nc + c];
+
+	    if (u < 0) {
+		ac->delta[r*nc + c] = f;
+		continue;
+	    }
+	    fail[u] = f;
+	    ac->dict[u] = (ac->out[f] >= 0) ? f : ac->dict[f];
+	    queue[tail++] = u;
+	}
+    }
+    ckfree((char *) fail);
+    ckfree((char *) queue);
+    return ac;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_compile --
+ *
+ *	Build the automata once all literals have been added
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_multi_compile(m)
+    struct exp_multi *m;
+{
+    if (m->compiled) return;
+    m->ac[0] = exp_ac_build(m,FALSE);
+    m->ac[1] = exp_ac_build(m,TRUE);
+    m->compiled = TRUE;
+}
+
+static void
+exp_multi_reset(m,sp,gen)
+    struct exp_multi *m;
+    struct exp_multi_scan *sp;
+    int gen;
+{
+    int i;
+
+    sp->gen = gen;
+    sp->scanned = 0;
+    sp->nul = -1;
+    sp->state[0] = sp->state[1] = 0;
+    for (i=0;i<m->nlit;i++) {
+	sp->first[i] = sp->last[i] = -1;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_update --
+ *
+ *	Bring the scan of a buffer up to date.  key identifies the
+ *	buffer (expect uses the struct exp_f) and gen its generation;
+ *	a new generation means chars were removed from the front and
+ *	the buffer is scanned again from the beginning.  Otherwise only
+ *	chars appended since the last call are looked at.  Nulls are
+ *	ordinary chars, but since the glob and regexp matchers stop at
+ *	the first one, its position is recorded.
+ *
+ * Results:
+ *	The up to date scan.  It belongs to the matcher.
+ *
+ *----------------------------------------------------------------------
+ */
+
+struct exp_multi_scan *
+exp_multi_update(m,key,gen,buf,len)
+    struct exp_multi *m;
+    ClientData key;
+    int gen;
+    char *buf;
+    int len;
+{
+    Tcl_HashEntry *hPtr;
+    struct exp_multi_scan *sp;
+    int new;
+    int i, k;
+
+    hPtr = Tcl_CreateHashEntry(&m->scans, (char *) key, &new);
+    if (new) {
+	sp = (struct exp_multi_scan *) ckalloc(sizeof(struct exp_multi_scan)
+				+ 2 * m->nlit * sizeof(int));
+	sp->first = (int *) (sp + 1);
+	sp->last = sp->first + m->nlit;
+	Tcl_SetHashValue(hPtr, sp);
+	exp_multi_reset(m,sp,gen);
+    } else {
+	sp = (struct exp_multi_scan *) Tcl_GetHashValue(hPtr);
+	if ((sp->gen != gen) || (len < sp->scanned)) {
+	    exp_multi_reset(m,sp,gen);
+	}
+    }
+
+    for (i=sp->scanned;i<len;i++) {
+	int c = (unsigned char) buf[i];
+
+	if ((c == 0) && (sp->nul < 0)) sp->nul = i;
+	for (k=0;k<2;k++) {
+	    struct exp_ac *ac = m->ac[k];
+	    int s, t, id;
+
+	    if (!ac) continue;
+	    s = ac->delta[sp->state[k]*ac->nclass + ac->map[c]];
+	    sp->state[k] = s;
+
+	    /* report every literal that ends here */
+	    for (t = (ac->out[s] >= 0) ? s : ac->dict[s]; t >= 0;
+		 t = ac->dict[t]) {
+		for (id = ac->out[t]; id >= 0; id = m->lits[id].same) {
+		    int start = i + 1 - m->lits[id].len;
+
+		    if (sp->first[id] < 0) sp->first[id] = start;
+		    sp->last[id] = start;
+		}
+	    }
+	}
+    }
+    sp->scanned = i;
+    return sp;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_multi_forget --
+ *
+ *	Discard whatever the matcher remembers about a buffer, e.g.,
+ *	because its spawn id is being closed
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_multi_forget(m,key)
+    struct exp_multi *m;
+    ClientData key;
+{
+    Tcl_HashEntry *hPtr;
+
+    hPtr = Tcl_FindHashEntry(&m->scans, (char *) key);
+    if (hPtr) {
+	ckfree((char *) Tcl_GetHashValue(hPtr));
+	Tcl_DeleteHashEntry(hPtr);
+    }
+}
@@ -0,0 +1,35 @@
+/* exp_multi.h - combined literal matcher used to prefilter expect cases */
+
+#ifndef _EXP_MULTI_H
+#define _EXP_MULTI_H
+
+/*
+ * What one scan of a buffer found.  For every literal, the offset of
+ * its first and last occurrence in the part of the buffer seen so far
+ * (or -1 if it hasn't occurred).  Scans are incremental: as long as
+ * the buffer generation doesn't change, only newly appended chars are
+ * looked at.
+ */
+struct exp_multi_scan {
+	int gen;		/* buffer generation this scan refers to */
+	int scanned;		/* # of chars of the buffer consumed so far */
+	int nul;		/* offset of the first null, or -1 */
+	int state[2];		/* automaton states at "scanned" */
+	int *first;		/* per literal: first occurrence or -1 */
+	int *last;		/* per literal: last occurrence or -1 */
+};
+
+struct exp_multi;
+
+extern struct exp_multi *exp_multi_new _ANSI_ARGS_((void));
+extern void		exp_multi_free _ANSI_ARGS_((struct exp_multi *));
+extern int		exp_multi_add _ANSI_ARGS_((struct exp_multi *,
+			    char *, int, int));
+extern int		exp_multi_count _ANSI_ARGS_((struct exp_multi *));
+extern void		exp_multi_compile _ANSI_ARGS_((struct exp_multi *));
+extern struct exp_multi_scan *exp_multi_update _ANSI_ARGS_((
+			    struct exp_multi *, ClientData, int, char *, int));
+extern void		exp_multi_forget _ANSI_ARGS_((struct exp_multi *,
+			    ClientData));
+
+#endif /* _EXP_MULTI_H */
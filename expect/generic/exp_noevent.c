@@ -68,6 +68,13 @@ exp_event_disarm(f)
 {
 }
 
+/*ARGSUSED*/
+void
+exp_event_unqueue(f)
+    struct exp_f *f;
+{
+}
+
 /* returns status, one of EOF, TIMEOUT, ERROR or DATA */
 /*ARGSUSED*/
 int exp_get_next_event(interp,masters, n,master_out,timeout,key)
@@ -75,7 +82,7 @@ int exp_get_next_event(interp,masters, n,master_out,timeout,key)
     struct exp_f **masters;	/* Array of expect process structures */
     int n;			/* # of masters */
     struct exp_f **master_out;	/* 1st ready master, not set if none */
-    int timeout;		/* seconds */
+    int timeout;		/* milliseconds */
     int key;
 {
     struct exp_f *f;
@@ -5,4 +5,7 @@
 #define regerror	TclRegError
 extern char *regbol;
 int regtry();
+int exp_regsearch();
+int exp_regliteral();
+int exp_reghasbol();
 
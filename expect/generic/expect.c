@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <ctype.h>	/* for isspace */
 #include <time.h>	/* for time(3) */
+#include <limits.h>	/* for LONG_MAX */
 
 #include "exp_port.h"
 
@@ -36,6 +37,8 @@
 #include "exp_command.h"
 #include "exp_log.h"
 #include "exp_event.h"
+#include "exp_regexp.h"
+#include "exp_multi.h"
 #include "exp_tstamp.h"	/* this should disappear when interact */
 			/* loses ref's to it */
 #ifdef TCL_DEBUGGER
@@ -82,6 +85,16 @@ struct ecase {	/* case for expect command */
 #define CASE_LOWER	2
     int Case;	/* convert case before doing match? */
     regexp *re;	/* if this is 0, then pattern match via glob */
+    struct exp_glob *glob;	/* compiled glob pattern, made when first */
+			/* needed */
+    struct exp_f *scan_f;	/* spawn id that scan_start refers to */
+    int scan_gen;	/* generation of scan_f's buffer at that time */
+    int scan_start;	/* no match can begin before this offset, so */
+			/* the next search may start here */
+    int lit;		/* id of a string every match must contain in */
+			/* the combined matcher, or -1 */
+    int lit_prefix;	/* if a match must also begin with it */
+    int lit_len;	/* length of that string */
 };
 
 /* descriptions of the pattern types, used for debugging */
@@ -90,6 +103,7 @@ char *pattern_style[PAT_TYPES];
 struct exp_cases_descriptor {
     int count;
     struct ecase **cases;
+    struct exp_multi *multi;	/* literals of all cases, built on demand */
 };
 
 /* This describes an Expect command */
@@ -99,8 +113,11 @@ struct exp_cmd_descriptor {
     int duration;			/* permanent or temporary */
     int timeout_specified_by_flag;	/* if -timeout flag used */
     int timeout;			/* timeout period if flag used */
+    int discard;			/* if -discard flag used */
+    int lazy;				/* if -lazy flag used */
     struct exp_cases_descriptor ecd;
     struct exp_i *i_list;
+    struct exp_case_set *cached;	/* if ecd belongs to the case cache */
 } exp_cmds[4];
 /* note that exp_cmds[FG] is just a fake, the real contents is stored
    in some dynamically-allocated variable.  We use exp_cmds[FG] mostly
@@ -117,9 +134,13 @@ exp_cmd_init(cmd,cmdtype,duration)
     cmd->cmdtype = cmdtype;
     cmd->ecd.cases = 0;
     cmd->ecd.count = 0;
+    cmd->ecd.multi = 0;
     cmd->i_list = 0;
+    cmd->cached = 0;
 }
 
+static void case_set_release _ANSI_ARGS_((struct exp_cmd_descriptor *));
+
 static int i_read_errno;/* place to save errno, if i_read() == -1, so it
 			   doesn't get overwritten before we get to read it */
 
@@ -144,36 +165,25 @@ static int		exp_i_read _ANSI_ARGS_((Tcl_Interp *,struct exp_f *,
 /*
  *----------------------------------------------------------------------
  *
- * rm_nulls --
+ * ecases_changed --
  *
- *	Remove nulls from s.  Initially, the number of chars in s is c,
- *	not strlen(s).  This count does not include the trailing null.
+ *	Discard the combined matcher when cases are added or removed.
+ *	It is rebuilt the next time the cases are evaluated.
  *
  * Results:
- *	Returns number of nulls removed.
+ *	None
  *
  *----------------------------------------------------------------------
  */
 
-static int
-rm_nulls(s,c)
-    char *s;
-    int c;
+static void
+ecases_changed(ecd)
+    struct exp_cases_descriptor *ecd;
 {
-    char *s2 = s;		/* points to place in original string to put */
-    /* next non-null character */
-    int count = 0;
-    int i;
-
-    for (i=0;i<c;i++,s++) {
-	if (0 == *s) {
-	    count++;
-	    continue;
-	}
-	if (count) *s2 = *s;
-	s2++;
+    if (ecd->multi) {
+	exp_multi_free(ecd->multi);
+	ecd->multi = 0;
     }
-    return(count);
 }
 
 /*
@@ -196,6 +206,7 @@ free_ecase(interp,ec,free_ilist)
     int free_ilist;		/* if we should free ilist */
 {
     if (ec->re) ckfree((char *)ec->re);
+    if (ec->glob) exp_glob_free(ec->glob);
 
     if (ec->i_list->duration == EXP_PERMANENT) {
 	if (ec->pat) ckfree(ec->pat);
@@ -232,6 +243,13 @@ free_ecases(interp,eg,free_ilist)
 {
     int i;
 
+    if (eg->cached) {
+	case_set_release(eg);
+	return;
+    }
+
+    ecases_changed(&eg->ecd);
+
     if (!eg->ecd.cases) return;
 
     for (i=0;i<eg->ecd.count;i++) {
@@ -374,6 +392,45 @@ exp_eval_with_one_arg(clientData,interp,argv)
     return(rc);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_eval_with_one_objarg --
+ *
+ *	exp_one_arg_braced and exp_eval_with_one_arg for object
+ *	commands.  If the command has all its args braced as one (or
+ *	uses -brace), it is run again with them expanded.
+ *
+ * Results:
+ *	TRUE if the command was run, with its result in *rcPtr
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+exp_eval_with_one_objarg(clientData,interp,objc,objv,rcPtr)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int objc;
+    Tcl_Obj *CONST objv[];
+    int *rcPtr;
+{
+    char *argv[2];
+
+    if (objc == 2) {
+	argv[1] = Tcl_GetStringFromObj(objv[1],(int *) NULL);
+	if (!exp_one_arg_braced(argv[1])) return FALSE;
+    } else if ((objc == 3)
+	       && streq(Tcl_GetStringFromObj(objv[1],(int *) NULL),"-brace")) {
+	argv[1] = Tcl_GetStringFromObj(objv[2],(int *) NULL);
+    } else {
+	return FALSE;
+    }
+    argv[0] = Tcl_GetStringFromObj(objv[0],(int *) NULL);
+    *rcPtr = exp_eval_with_one_arg(clientData,interp,argv);
+    return TRUE;
+}
+
 static void
 ecase_clear(ec)
     struct ecase *ec;
@@ -387,8 +444,15 @@ ecase_clear(ec)
     ec->iread = FALSE;
     ec->timestamp = FALSE;
     ec->re = 0;
+    ec->glob = 0;
     ec->Case = CASE_NORM;
     ec->use = PAT_GLOB;
+    ec->scan_f = 0;
+    ec->scan_gen = 0;
+    ec->scan_start = 0;
+    ec->lit = -1;
+    ec->lit_prefix = FALSE;
+    ec->lit_len = 0;
 }
 
 static struct ecase *
@@ -435,23 +499,56 @@ ecase_new()
  */
 
 static int
-parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
+parse_expect_args(interp,eg,default_spawn_id,objc,objv,argv0)
     Tcl_Interp *interp;
     struct exp_cmd_descriptor *eg;
     struct exp_f *default_spawn_id; /* suggested master if called as
 				     * expect_user or _tty */
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
     char *argv0;
 {
     int i;
     char *arg;
+    int index;
     struct ecase ec;		/* temporary to collect args */
-
-    argv++;
-    argc--;
+    static char *flags[] = {
+	"--", "-glob", "-regexp", "-exact", "-notransfer", "-nocase",
+	"-i", "-indices", "-iwrite", "-iread", "-timestamp", "-timeout",
+	"-discard", "-lazy", "-nobrace", (char *) NULL
+    };
+    enum flags {
+	EXP_ARG_DASHDASH, EXP_ARG_GLOB, EXP_ARG_REGEXP, EXP_ARG_EXACT,
+	EXP_ARG_NOTRANSFER, EXP_ARG_NOCASE, EXP_ARG_I, EXP_ARG_INDICES,
+	EXP_ARG_IWRITE, EXP_ARG_IREAD, EXP_ARG_TIMESTAMP, EXP_ARG_TIMEOUT,
+	EXP_ARG_DISCARD, EXP_ARG_LAZY, EXP_ARG_NOBRACE
+    };
+    /*
+     * Prefixes several flags share are rejected by Tcl_GetIndexFromObj,
+     * but these have always chosen a flag (the man page documents -n).
+     * They are tried in their historical order.
+     */
+    static struct {
+	char *name;
+	int minlen;
+	int index;
+    } abbrevs[] = {
+	{"-notransfer",	2,	EXP_ARG_NOTRANSFER},
+	{"-timestamp",	3,	EXP_ARG_TIMESTAMP},
+	{(char *) NULL,	0,	0}
+    };
+
+/* the string of objv[i], or NULL past the end as in an argv */
+#define objv_str(i)	(((i) < objc) \
+			 ? Tcl_GetStringFromObj(objv[i],(int *) NULL) \
+			 : (char *) NULL)
+
+    objv++;
+    objc--;
 
     eg->timeout_specified_by_flag = FALSE;
+    eg->discard = FALSE;
+    eg->lazy = FALSE;
 
     ecase_clear(&ec);
 
@@ -460,12 +557,12 @@ parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
     /* but won't affect anything. */
 
     eg->ecd.cases = (struct ecase **)
-	ckalloc(sizeof(struct ecase *) * (1+(argc/2)));
+	ckalloc(sizeof(struct ecase *) * (1+(objc/2)));
 
     eg->ecd.count = 0;
 
-    for (i = 0;i<argc;i++) {
-	arg = argv[i];
+    for (i = 0;i<objc;i++) {
+	arg = objv_str(i);
 	
 	if (exp_flageq("timeout",arg,7)) {
 	    ec.use = PAT_TIMEOUT;
@@ -478,39 +575,58 @@ parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
 	} else if (exp_flageq("null",arg,4)) {
 	    ec.use = PAT_NULL;
 	} else if (arg[0] == '-') {
-	    arg++;
-	    if (exp_flageq1('-',arg) /* "--" is deprecated */
-		|| exp_flageq("glob",arg,2)) {
+	    if (Tcl_GetIndexFromObj((Tcl_Interp *) NULL, objv[i], flags,
+				    "flag", 0, &index) != TCL_OK) {
+		int a;
+
+		for (a = 0;abbrevs[a].name;a++) {
+		    if (exp_flageq(abbrevs[a].name,arg,abbrevs[a].minlen)) {
+			index = abbrevs[a].index;
+			break;
+		    }
+		}
+		if (!abbrevs[a].name) {
+		    exp_error(interp,"usage: unrecognized flag <%.80s>",
+			      arg+1);
+		    goto error;
+		}
+	    }
+	    switch ((enum flags) index) {
+	    case EXP_ARG_DASHDASH:	/* "--" is deprecated */
+	    case EXP_ARG_GLOB:
 		i++;
 		/* assignment here is not actually necessary */
 		/* since cases are initialized this way above */
 		/* ec.use = PAT_GLOB; */
-	    } else if (exp_flageq("regexp",arg,2)) {
+		break;
+	    case EXP_ARG_REGEXP:
 		i++;
 		ec.use = PAT_RE;
 		TclRegError((char *)0);
-		if (!(ec.re = TclRegComp(argv[i]))) {
+		if (!(ec.re = TclRegComp(objv_str(i)))) {
 		    exp_error(interp,"bad regular expression: %s",
 			      TclGetRegError());
 		    goto error;
 		}
-	    } else if (exp_flageq("exact",arg,2)) {
+		break;
+	    case EXP_ARG_EXACT:
 		i++;
 		ec.use = PAT_EXACT;
-	    } else if (exp_flageq("notransfer",arg,1)) {
+		break;
+	    case EXP_ARG_NOTRANSFER:
 		ec.transfer = 0;
 		continue;
-	    } else if (exp_flageq("nocase",arg,3)) {
+	    case EXP_ARG_NOCASE:
 		ec.Case = CASE_LOWER;
 		continue;
-	    } else if (exp_flageq1('i',arg)) {
+	    case EXP_ARG_I:
 		i++;
-		if (i>=argc) {
+		if (i>=objc) {
 		    exp_error(interp,"-i requires following spawn_id");
 		    goto error;
 		}
 
-		ec.i_list = exp_new_i_complex(interp,argv[i],
+		ec.i_list = exp_new_i_complex(interp,objv_str(i),
 					      eg->duration,exp_indirect_update2,
 					      argv0);
 		if (ec.i_list == NULL) {
@@ -523,38 +639,41 @@ parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
 		eg->i_list = ec.i_list;
 
 		continue;
-	    } else if (exp_flageq("indices",arg,2)) {
+	    case EXP_ARG_INDICES:
 		ec.indices = TRUE;
 		continue;
-	    } else if (exp_flageq("iwrite",arg,2)) {
+	    case EXP_ARG_IWRITE:
 		/*				ec.iwrite = TRUE;*/
 		continue;
-	    } else if (exp_flageq("iread",arg,2)) {
+	    case EXP_ARG_IREAD:
 		ec.iread = TRUE;
 		continue;
-	    } else if (exp_flageq("timestamp",arg,2)) {
+	    case EXP_ARG_TIMESTAMP:
 		ec.timestamp = TRUE;
 		continue;
-	    } else if (exp_flageq("timeout",arg,2)) {
+	    case EXP_ARG_TIMEOUT:
 		i++;
-		if (i>=argc) {
+		if (i>=objc) {
 		    exp_error(interp,"-timeout requires following # of seconds");
 		    goto error;
 		}
 
-		eg->timeout = atoi(argv[i]);
+		eg->timeout = exp_msec_arg(objv_str(i));
 		eg->timeout_specified_by_flag = TRUE;
 		continue;
-	    } else if (exp_flageq("nobrace",arg,7)) {
+	    case EXP_ARG_DISCARD:
+		eg->discard = TRUE;
+		continue;
+	    case EXP_ARG_LAZY:
+		eg->lazy = TRUE;
+		continue;
+	    case EXP_ARG_NOBRACE:
 		/* nobrace does nothing but take up space */
 		/* on the command line which prevents */
 		/* us from re-expanding any command lines */
 		/* of one argument that looks like it should */
 		/* be expanded to multiple arguments. */
 		continue;
-	    } else {
-		exp_error(interp,"usage: unrecognized flag <%s>",arg);
-		goto error;
 	    }
 	}
 
@@ -577,8 +696,8 @@ parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
 	/* save original pattern spec */
 	/* keywords such as "-timeout" are saved as patterns here */
 	/* useful for debugging but not otherwise used */
-	save_str(&ec.pat,argv[i],eg->duration == EXP_TEMPORARY);
-	save_str(&ec.body,argv[i+1],eg->duration == EXP_TEMPORARY);
+	save_str(&ec.pat,objv_str(i),eg->duration == EXP_TEMPORARY);
+	save_str(&ec.body,objv_str(i+1),eg->duration == EXP_TEMPORARY);
 			
 	i++;
 
@@ -624,6 +743,7 @@ parse_expect_args(interp,eg,default_spawn_id,argc,argv,argv0)
 	exp_free_i(interp,eg->i_list,exp_indirect_update2);
     return(TCL_ERROR);
 }
+#undef objv_str
 
 #define EXP_IS_DEFAULT(x)	((x) == EXP_TIMEOUT || (x) == EXP_EOF)
 
@@ -631,6 +751,511 @@ static char yes[] = "yes\r\n";
 static char no[] = "no\r\n";
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_scan_save --
+ *
+ *	Remember how far into f's buffer the ecase has already looked
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_scan_save(e,f,resume)
+    struct ecase *e;
+    struct exp_f *f;
+    int resume;		/* no match can begin before this offset */
+{
+    if (resume < 0) resume = 0;
+    if (resume > f->size) resume = f->size;
+    e->scan_f = f;
+    e->scan_gen = f->generation;
+    e->scan_start = resume;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ecases_compile --
+ *
+ *	Build the combined matcher for a set of cases.  Every -ex
+ *	string, and the longest literal part of each glob and regexp,
+ *	goes into it so that one pass over a buffer tells which cases
+ *	are worth trying at all.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Sets ecd->multi and the lit fields of each ecase
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ecases_compile(ecd)
+    struct exp_cases_descriptor *ecd;
+{
+    struct exp_multi *m = exp_multi_new();
+    int i;
+
+    for (i=0;i<ecd->count;i++) {
+	struct ecase *e = ecd->cases[i];
+	char *lit = 0;
+	char *globlit = 0;
+	int len = 0;
+	int prefix = FALSE;
+
+	e->lit = -1;
+	e->lit_prefix = FALSE;
+
+	if (e->use == PAT_EXACT) {
+	    lit = e->pat;
+	    len = strlen(lit);
+	    prefix = TRUE;
+	} else if (e->use == PAT_GLOB) {
+	    globlit = ckalloc(strlen(e->pat) + 1);
+	    lit = globlit;
+	    len = exp_glob_literal(e->pat,lit,&prefix);
+	} else if (e->use == PAT_RE) {
+	    len = exp_regliteral(e->re,&lit,&prefix);
+	}
+
+	if (len > 0) {
+	    int fold = (e->Case == CASE_LOWER);
+	    int j;
+
+	    /*
+	     * -nocase patterns are matched against the lowercased
+	     * buffer, where uppercase can never appear.  Leave those
+	     * alone rather than rule them out here.
+	     */
+	    for (j=0;fold && j<len;j++) {
+		if (isascii(lit[j]) && isupper(lit[j])) break;
+	    }
+	    if (!fold || j == len) {
+		e->lit = exp_multi_add(m,lit,len,fold);
+		e->lit_prefix = prefix;
+		e->lit_len = len;
+	    }
+	}
+	if (globlit) ckfree(globlit);
+    }
+    exp_multi_compile(m);
+    ecd->multi = m;
+}
+
+/*
+ * Scripts tend to run the same expect command over and over, e.g., in
+ * a loop.  Rather than parse the arguments, compile the regexps and
+ * build the combined matcher every time, the resulting cases are kept
+ * in a cache keyed by the text of the arguments.  Only the -i lists
+ * are rebuilt on each use since they depend on the spawn ids of the
+ * moment.
+ *
+ * A command compiled into a proc or loop body is passed the same
+ * argument objects each time it runs.  Each case set holds on to the
+ * objects it was last used with, so such a command finds its cases
+ * by comparing pointers, without looking at the text at all.
+ */
+
+#define EXP_CASE_CACHE_SIZE	64	/* max # of cached case sets */
+
+struct exp_case_set {
+    char *key;			/* the arguments, as a list */
+    int objc;			/* the argument objects last used with */
+    Tcl_Obj **objv;		/* these cases, one reference each */
+    int busy;			/* if in use by an expect command */
+    struct exp_cases_descriptor ecd;
+    int timeout_specified_by_flag;
+    int timeout;
+    int discard;
+    int lazy;
+    int ispecs;			/* # of -i flags */
+    char **ispec;		/* argument of each -i flag */
+    int *ispec_at;		/* # of cases preceding each -i flag */
+    struct exp_case_set *newer;	/* LRU chain */
+    struct exp_case_set *older;
+};
+
+static Tcl_HashTable case_cache;
+static int case_cache_count = 0;
+static struct exp_case_set *case_cache_newest = 0;
+static struct exp_case_set *case_cache_oldest = 0;
+
+static void
+case_set_unlink(cs)
+    struct exp_case_set *cs;
+{
+    if (cs->newer) cs->newer->older = cs->older;
+    else case_cache_newest = cs->older;
+    if (cs->older) cs->older->newer = cs->newer;
+    else case_cache_oldest = cs->newer;
+}
+
+static void
+case_set_link(cs)
+    struct exp_case_set *cs;
+{
+    cs->newer = 0;
+    cs->older = case_cache_newest;
+    if (case_cache_newest) case_cache_newest->newer = cs;
+    else case_cache_oldest = cs;
+    case_cache_newest = cs;
+}
+
+/* remember the argument objects the case set is being used with */
+static void
+case_set_objs(cs,objc,objv)
+    struct exp_case_set *cs;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    int i;
+
+    for (i=0;i<objc;i++) {
+	Tcl_IncrRefCount(objv[i]);
+    }
+    for (i=0;i<cs->objc;i++) {
+	Tcl_DecrRefCount(cs->objv[i]);
+    }
+    if (objc != cs->objc) {
+	if (cs->objv) ckfree((char *)cs->objv);
+	cs->objv = 0;
+	if (objc) cs->objv = (Tcl_Obj **)ckalloc(objc * sizeof(Tcl_Obj *));
+	cs->objc = objc;
+    }
+    for (i=0;i<objc;i++) {
+	cs->objv[i] = objv[i];
+    }
+}
+
+/* true if the case set was last used with these very objects */
+static int
+case_set_same_objs(cs,objc,objv)
+    struct exp_case_set *cs;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    int i;
+
+    if (objc != cs->objc) return FALSE;
+    for (i=0;i<objc;i++) {
+	if (objv[i] != cs->objv[i]) return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+case_set_free(cs)
+    struct exp_case_set *cs;
+{
+    int i;
+
+    for (i=0;i<cs->ecd.count;i++) {
+	struct ecase *e = cs->ecd.cases[i];
+
+	if (e->re) ckfree((char *)e->re);
+	if (e->glob) exp_glob_free(e->glob);
+	if (e->pat) ckfree(e->pat);
+	if (e->body) ckfree(e->body);
+	ckfree((char *)e);
+    }
+    ckfree((char *)cs->ecd.cases);
+    if (cs->ecd.multi) exp_multi_free(cs->ecd.multi);
+    for (i=0;i<cs->ispecs;i++) {
+	ckfree(cs->ispec[i]);
+    }
+    if (cs->ispec) ckfree((char *)cs->ispec);
+    if (cs->ispec_at) ckfree((char *)cs->ispec_at);
+    case_set_objs(cs,0,(Tcl_Obj *CONST *) NULL);
+    ckfree(cs->key);
+    ckfree((char *)cs);
+}
+
+/* evict the least recently used case sets that aren't in use */
+static void
+case_cache_trim()
+{
+    struct exp_case_set *cs, *newer;
+
+    for (cs = case_cache_oldest;
+	 cs && (case_cache_count > EXP_CASE_CACHE_SIZE);cs = newer) {
+	newer = cs->newer;
+	if (cs->busy) continue;
+
+	case_set_unlink(cs);
+	Tcl_DeleteHashEntry(Tcl_FindHashEntry(&case_cache,cs->key));
+	case_cache_count--;
+	case_set_free(cs);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * case_set_release --
+ *
+ *	Called in place of free_ecases when an expect command is done
+ *	with cases that belong to the cache
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+case_set_release(eg)
+    struct exp_cmd_descriptor *eg;
+{
+    eg->cached->busy = FALSE;
+    eg->cached = 0;
+    eg->ecd.cases = 0;
+    eg->ecd.count = 0;
+    eg->ecd.multi = 0;
+
+    case_cache_trim();
+}
+
+/* create an i_list for the default spawn id as parse_expect_args does */
+static struct exp_i *
+case_set_default_i(interp,eg,default_spawn_id)
+    Tcl_Interp *interp;
+    struct exp_cmd_descriptor *eg;
+    struct exp_f *default_spawn_id;
+{
+    if (default_spawn_id == NULL) {
+	/* it'll be checked later, if used */
+	default_spawn_id = exp_update_master(interp,0,0);
+    }
+    return exp_new_i_simple(default_spawn_id,eg->duration);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * case_set_new --
+ *
+ *	Move freshly parsed cases into the cache.  eg keeps using them
+ *	from there.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+case_set_new(eg,key,objc,objv)
+    struct exp_cmd_descriptor *eg;
+    char *key;
+    int objc;			/* the arguments, without the command */
+    Tcl_Obj *CONST objv[];	/* name */
+{
+    struct exp_case_set *cs;
+    struct exp_i *exp_i;
+    struct exp_i **made;	/* i_lists in order of creation */
+    int nmade = 0;
+    int i, j, new;
+
+    cs = (struct exp_case_set *)ckalloc(sizeof(struct exp_case_set));
+    cs->key = ckalloc(strlen(key) + 1);
+    strcpy(cs->key,key);
+    cs->objc = 0;
+    cs->objv = 0;
+    case_set_objs(cs,objc,objv);
+    cs->busy = TRUE;
+    cs->ecd = eg->ecd;
+    cs->timeout_specified_by_flag = eg->timeout_specified_by_flag;
+    cs->timeout = eg->timeout;
+    cs->discard = eg->discard;
+    cs->lazy = eg->lazy;
+
+    /* patterns and bodies still point into the command's arguments */
+    for (i=0;i<cs->ecd.count;i++) {
+	struct ecase *e = cs->ecd.cases[i];
+
+	save_str(&e->pat,e->pat,FALSE);
+	save_str(&e->body,e->body,FALSE);
+    }
+
+    /*
+     * Remember each -i and how many cases preceded it.  The default
+     * i_list is the only one without a value or variable.
+     */
+    for (exp_i=eg->i_list;exp_i;exp_i=exp_i->next) nmade++;
+    made = (struct exp_i **)ckalloc((nmade+1) * sizeof(struct exp_i *));
+    for (i=nmade,exp_i=eg->i_list;exp_i;exp_i=exp_i->next) {
+	made[--i] = exp_i;
+    }
+    cs->ispecs = 0;
+    cs->ispec = (char **)ckalloc((nmade+1) * sizeof(char *));
+    cs->ispec_at = (int *)ckalloc((nmade+1) * sizeof(int));
+    j = 0;
+    for (i=0;i<nmade;i++) {
+	char *arg = made[i]->value ? made[i]->value : made[i]->variable;
+
+	if (!arg) continue;
+
+	/* cases are in creation order of their i_lists */
+	for (;j<cs->ecd.count;j++) {
+	    int pos;
+
+	    for (pos=0;made[pos] != cs->ecd.cases[j]->i_list;pos++) ;
+	    if (pos >= i) break;
+	}
+	save_str(&cs->ispec[cs->ispecs],arg,FALSE);
+	cs->ispec_at[cs->ispecs] = j;
+	cs->ispecs++;
+    }
+    ckfree((char *)made);
+
+    ecases_compile(&cs->ecd);
+
+    Tcl_SetHashValue(Tcl_CreateHashEntry(&case_cache,cs->key,&new),cs);
+    case_set_link(cs);
+    case_cache_count++;
+
+    eg->cached = cs;
+    eg->ecd = cs->ecd;
+
+    case_cache_trim();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * case_set_use --
+ *
+ *	Set up eg to use cached cases, rebuilding the -i lists
+ *
+ * Results:
+ *	A standard TCL result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+case_set_use(interp,eg,cs,default_spawn_id,argv0)
+    Tcl_Interp *interp;
+    struct exp_cmd_descriptor *eg;
+    struct exp_case_set *cs;
+    struct exp_f *default_spawn_id;
+    char *argv0;
+{
+    int i, s = 0;
+
+    eg->timeout_specified_by_flag = cs->timeout_specified_by_flag;
+    eg->discard = cs->discard;
+    eg->lazy = cs->lazy;
+    eg->timeout = cs->timeout;
+
+    for (i=0;;i++) {
+	/* create the i_lists of the -i flags that preceded this case */
+	for (;(s < cs->ispecs) && (cs->ispec_at[s] <= i);s++) {
+	    struct exp_i *exp_i;
+
+	    exp_i = exp_new_i_complex(interp,cs->ispec[s],eg->duration,
+				      exp_indirect_update2,argv0);
+	    if (exp_i == NULL) {
+		exp_free_i(interp,eg->i_list,exp_indirect_update2);
+		eg->i_list = 0;
+		return(TCL_ERROR);
+	    }
+	    exp_i->cmdtype = eg->cmdtype;
+	    exp_i->next = eg->i_list;
+	    eg->i_list = exp_i;
+	}
+	if (i == cs->ecd.count) break;
+
+	/* if no -i, use previous one */
+	if (!eg->i_list) {
+	    eg->i_list = case_set_default_i(interp,eg,default_spawn_id);
+	}
+	cs->ecd.cases[i]->i_list = eg->i_list;
+	eg->i_list->ecount++;
+    }
+
+    if (!eg->i_list) {
+	eg->i_list = case_set_default_i(interp,eg,default_spawn_id);
+    }
+
+    cs->busy = TRUE;
+    case_set_unlink(cs);
+    case_set_link(cs);
+
+    eg->cached = cs;
+    eg->ecd = cs->ecd;
+    return(TCL_OK);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * parse_expect_args_cached --
+ *
+ *	Like parse_expect_args but reuses the cases of an earlier
+ *	expect command with the same arguments if possible
+ *
+ * Results:
+ *	A standard TCL result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+parse_expect_args_cached(interp,eg,default_spawn_id,objc,objv,argv0)
+    Tcl_Interp *interp;
+    struct exp_cmd_descriptor *eg;
+    struct exp_f *default_spawn_id;
+    int objc;
+    Tcl_Obj *CONST objv[];
+    char *argv0;
+{
+    Tcl_DString key;
+    Tcl_HashEntry *hPtr;
+    struct exp_case_set *cs;
+    int i;
+    int rc;
+
+    for (cs=case_cache_newest;cs;cs=cs->older) {
+	if (case_set_same_objs(cs,objc-1,objv+1)) break;
+    }
+
+    Tcl_DStringInit(&key);
+    if (!cs) {
+	for (i=1;i<objc;i++) {
+	    Tcl_DStringAppendElement(&key,
+			Tcl_GetStringFromObj(objv[i],(int *) NULL));
+	}
+
+	hPtr = Tcl_FindHashEntry(&case_cache,Tcl_DStringValue(&key));
+	if (hPtr) {
+	    cs = (struct exp_case_set *)Tcl_GetHashValue(hPtr);
+	    if (!cs->busy) case_set_objs(cs,objc-1,objv+1);
+	}
+    }
+
+    if (cs && !cs->busy) {
+	rc = case_set_use(interp,eg,cs,default_spawn_id,argv0);
+    } else {
+	rc = parse_expect_args(interp,eg,default_spawn_id,objc,objv,argv0);
+
+	/* a recursive expect with the same arguments keeps its own */
+	if ((rc == TCL_OK) && !cs) {
+	    case_set_new(eg,Tcl_DStringValue(&key),objc-1,objv+1);
+	}
+    }
+
+    Tcl_DStringFree(&key);
+    return(rc);
+}
+
 /* this describes status of a successful match */
 struct eval_out {
     struct ecase *e;		/* ecase that matched */
@@ -640,10 +1265,17 @@ struct eval_out {
     /* or # of chars in buffer at EOF */
 };
 
+/*
+ * Set while an expect -discard looks at its cases.  Only then is it
+ * worth a full search to learn how much of the buffer a case the
+ * combined matcher has already ruled out can never match.
+ */
+static int exp_want_resume = FALSE;
+
 /*
  *----------------------------------------------------------------------
  *
- * eval_case_string --
+ * eval_case_try --
  *
  *	Like eval_cases, but handles only a single cases that needs a real
  *	string match
@@ -654,7 +1286,7 @@ struct eval_out {
  *----------------------------------------------------------------------
  */
 static int
-eval_case_string(interp,e,f,o,last_f,last_case,suffix)
+eval_case_try(interp,e,f,o,last_f,last_case,suffix,multi)
     Tcl_Interp *interp;
     struct ecase *e;
     struct exp_f *f;
@@ -664,24 +1296,90 @@ eval_case_string(interp,e,f,o,last_f,last_case,suffix)
     struct exp_f **last_f;
     int *last_case;
     char *suffix;
+    struct exp_multi *multi;	/* combined matcher for e's command */
 {
     char *buffer;
+    int start = 0;		/* where the search may begin */
+    int resume;			/* where the next search may begin */
+    int hopeless = FALSE;	/* if e's literal rules out a match */
+    int lit_resume = -1;	/* if hopeless, where a match could still */
+				/* begin, if the literal tells */
+    int exact = -1;		/* where an -ex match begins, if known */
     
     /* if -nocase, use the lowerized buffer */
-    buffer = ((e->Case == CASE_NORM)?f->buffer:f->lower);
+    buffer = ((e->Case == CASE_NORM)?f->buffer:exp_buffer_lower(f));
+
+    /*
+     * Data is only ever appended to a buffer until something is
+     * removed from its front, so anything this case ruled out the
+     * last time it looked at this buffer is still ruled out.
+     */
+    if ((e->scan_f == f) && (e->scan_gen == f->generation)) {
+	start = e->scan_start;
+	if (start > f->size) start = f->size;
+    }
+
+    /*
+     * Let the combined matcher rule out the case, or move the start
+     * up to where its literal first occurs if a match must begin
+     * with it.  -ex cases are answered directly.
+     */
+    if (multi && (e->lit >= 0) && buffer) {
+	struct exp_multi_scan *sp;
+	int first;
+
+	sp = exp_multi_update(multi,(ClientData)f,f->generation,
+			      f->buffer,f->size);
+	first = sp->first[e->lit];
+	if (sp->last[e->lit] < start) {
+	    hopeless = TRUE;
+	    if (e->lit_prefix) {
+		/* only the last len-1 chars could begin the literal */
+		lit_resume = f->size - e->lit_len + 1;
+		if (lit_resume < start) lit_resume = start;
+	    }
+	} else if (e->use == PAT_EXACT) {
+	    if (first >= start) exact = first;
+	} else if ((sp->nul >= 0) && (first >= sp->nul)) {
+	    /* globs and regexps don't look beyond a null */
+	    hopeless = TRUE;
+	} else if (e->lit_prefix && (first >= start)) {
+	    start = first;
+	}
+    }
     
     /* if master or case changed, redisplay debug-buffer */
     if ((f != *last_f) || e->Case != *last_case) {
-	debuglog("\r\nexpect%s: does \"%s\" (spawn_id %s) match %s ",
-		 suffix, dprintify(buffer),f->spawnId, pattern_style[e->use]);
+	if (EXP_DEBUGGING) {
+	    debuglog("\r\nexpect%s: does \"",suffix);
+	    exp_debuglog_printify(buffer,buffer?f->size:-1);
+	    debuglog("\" (spawn_id %s) match %s ",
+		     f->spawnId, pattern_style[e->use]);
+	}
 	*last_f = f;
 	*last_case = e->Case;
     }
     
     if (e->use == PAT_RE) {
+	int r;
+
 	debuglog("\"%s\"? ",dprintify(e->pat));
 	TclRegError((char *)0);
-	if (buffer && TclRegExec(e->re,buffer,buffer)) {
+	if (buffer && hopeless &&
+	    ((lit_resume >= 0) || !exp_want_resume)) {
+	    exp_scan_save(e,f,(lit_resume >= 0)?lit_resume:start);
+	    r = EXP_CANTMATCH;
+	} else if (buffer) {
+	    /*
+	     * If the literal rules out a match, -discard still needs
+	     * the search to tell how much of the buffer it rules out.
+	     */
+	    r = exp_regsearch(e->re,buffer,start,&resume);
+	    exp_scan_save(e,f,resume);
+	} else {
+	    r = EXP_CANTMATCH;
+	}
+	if (r == EXP_MATCH) {
 	    o->e = e;
 	    o->match = e->re->endp[0]-buffer;
 	    o->buffer = buffer;
@@ -696,11 +1394,20 @@ eval_case_string(interp,e,f,o,last_f,last_case,suffix)
 	    }
 	}
     } else if (e->use == PAT_GLOB) {
-	int match;		/* # of chars that matched */
+	int match = -1;		/* # of chars that matched */
 	
 	debuglog("\"%s\"? ",dprintify(e->pat));
-	if (buffer && (-1 != (match = Exp_StringMatch(
-						      buffer,e->pat,&e->simple_start)))) {
+	if (buffer && hopeless &&
+	    ((lit_resume >= 0) || !exp_want_resume)) {
+	    exp_scan_save(e,f,(lit_resume >= 0)?lit_resume:start);
+	} else if (buffer) {
+	    /* as for -re, let the search say where to resume */
+	    if (!e->glob) e->glob = exp_glob_compile(e->pat);
+	    match = exp_glob_exec(e->glob,buffer,start,
+				  &e->simple_start,&resume);
+	    exp_scan_save(e,f,resume);
+	}
+	if (match != -1) {
 	    o->e = e;
 	    o->match = match;
 	    o->buffer = buffer;
@@ -709,22 +1416,34 @@ eval_case_string(interp,e,f,o,last_f,last_case,suffix)
 	    return(EXP_MATCH);
 	} else debuglog(no);
     } else if (e->use == PAT_EXACT) {
-	char *p = strstr(buffer,e->pat);
+	int len = strlen(e->pat);
+	char *p;
+
+	if (hopeless) p = 0;
+	else if (exact >= 0) p = buffer + exact;
+	else p = exp_memmem(buffer+start,f->size-start,e->pat,len);
 	debuglog("\"%s\"? ",dprintify(e->pat));
 	if (p) {
 	    e->simple_start = p - buffer;
+	    exp_scan_save(e,f,e->simple_start);
 	    o->e = e;
-	    o->match = strlen(e->pat);
+	    o->match = len;
 	    o->buffer = buffer;
 	    o->f = f;
 	    debuglog(yes);
 	    return(EXP_MATCH);
-	} else debuglog(no);
+	} else {
+	    /* only the last len-1 chars could begin a match */
+	    resume = f->size - len + 1;
+	    exp_scan_save(e,f,(resume > start)?resume:start);
+	    debuglog(no);
+	}
     } else if (e->use == PAT_NULL) {
-	int i = 0;
+	int i = start;
 	debuglog("null? ");
 	for (;i<f->size;i++) {
 	    if (buffer[i] == 0) {
+		exp_scan_save(e,f,i);
 		o->e = e;
 		o->match = i+1;	/* in this case, match is */
 		/* just the # of chars + 1 */
@@ -735,6 +1454,7 @@ eval_case_string(interp,e,f,o,last_f,last_case,suffix)
 		return EXP_MATCH;
 	    }
 	}
+	exp_scan_save(e,f,f->size);
 	debuglog(no);
     } else if ((f->size == f->msize) && (f->size > 0)) {
 	debuglog("%s? ",e->pat);
@@ -745,7 +1465,46 @@ eval_case_string(interp,e,f,o,last_f,last_case,suffix)
 	debuglog(yes);
 	return(EXP_FULLBUFFER);
     }
-    return(EXP_NOMATCH);
+    return(EXP_NOMATCH);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * eval_case_string --
+ *
+ *	eval_case_try, counted in f's stats.  The time spent is
+ *	measured once for all the cases, by the caller of eval_cases.
+ *
+ * Results:
+ *	As for eval_case_try
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+eval_case_string(interp,e,f,o,last_f,last_case,suffix,multi)
+    Tcl_Interp *interp;
+    struct ecase *e;
+    struct exp_f *f;
+    struct eval_out *o;
+    struct exp_f **last_f;
+    int *last_case;
+    char *suffix;
+    struct exp_multi *multi;
+{
+    int rc;
+
+    switch (e->use) {
+    case PAT_GLOB:	f->stats.glob++;	break;
+    case PAT_RE:	f->stats.re++;		break;
+    case PAT_EXACT:	f->stats.exact++;	break;
+    case PAT_NULL:	f->stats.null++;	break;
+    default:		f->stats.full_buffer++;	break;
+    }
+
+    rc = eval_case_try(interp,e,f,o,last_f,last_case,suffix,multi);
+    if (rc == EXP_MATCH || rc == EXP_FULLBUFFER) f->stats.matches++;
+    return(rc);
 }
 
 /*
@@ -812,6 +1571,8 @@ eval_cases(interp,eg,f,o,last_f,last_case,status,masters,mcount,suffix)
     
     /* the top loops are split from the bottom loop only because I can't */
     /* split'em further. */
+
+    if (!eg->ecd.multi) ecases_compile(&eg->ecd);
     
     /* The bufferful condition does not prevent a pattern match from */
     /* occurring and vice versa, so it is scanned with patterns */
@@ -831,14 +1592,14 @@ eval_cases(interp,eg,f,o,last_f,last_case,status,masters,mcount,suffix)
 	    if (em == NULL || em == exp_f_any) {
 		/* test against each spawn_id */
 		for (j=0;j<mcount;j++) {
-		    status = eval_case_string(interp,e,masters[j],o,last_f,last_case,suffix);
+		    status = eval_case_string(interp,e,masters[j],o,last_f,last_case,suffix,eg->ecd.multi);
 		    if (status != EXP_NOMATCH) return(status);
 		}
 	    } else {
 		/* reject things immediately from wrong spawn_id */
 		if (em != f) continue;
 
-		status = eval_case_string(interp,e,f,o,last_f,last_case,suffix);
+		status = eval_case_string(interp,e,f,o,last_f,last_case,suffix,eg->ecd.multi);
 		if (status != EXP_NOMATCH) return(status);
 	    }
 	}
@@ -854,6 +1615,8 @@ ecases_remove_by_expi(interp,ecmd,exp_i)
 {
     int i;
 
+    ecases_changed(&ecmd->ecd);
+
     /* delete every ecase dependent on it */
     for (i=0;i<ecmd->ecd.count;) {
 	struct ecase *e = ecmd->ecd.cases[i];
@@ -958,10 +1721,23 @@ exp_ecmd_remove_f_direct_and_indirect(interp,f)
     Tcl_Interp *interp;
     struct exp_f *f;
 {
+    struct exp_case_set *cs;
+    int i;
+
     ecmd_remove_f(interp,&exp_cmds[EXP_CMD_BEFORE],f,EXP_DIRECT|EXP_INDIRECT);
     ecmd_remove_f(interp,&exp_cmds[EXP_CMD_AFTER],f,EXP_DIRECT|EXP_INDIRECT);
     ecmd_remove_f(interp,&exp_cmds[EXP_CMD_BG],f,EXP_DIRECT|EXP_INDIRECT);
 
+    /* the combined matchers needn't remember f's buffer any more */
+    for (i=EXP_CMD_BEFORE;i<=EXP_CMD_BG;i++) {
+	if (exp_cmds[i].ecd.multi) {
+	    exp_multi_forget(exp_cmds[i].ecd.multi,(ClientData)f);
+	}
+    }
+    for (cs=case_cache_newest;cs;cs=cs->older) {
+	exp_multi_forget(cs->ecd.multi,(ClientData)f);
+    }
+
     /* force it - explanation in exp_tk.c where this func is defined */
     exp_disarm_background_filehandler_force(f);
 }
@@ -1073,11 +1849,12 @@ exp_i_append(interp,exp_i)
  */
 
 int
-expect_info(interp,ecmd,argc,argv)
+expect_info(interp,ecmd,objc,objv,argv0)
     Tcl_Interp *interp;
     struct exp_cmd_descriptor *ecmd;
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
+    char *argv0;
 {
     struct exp_i *exp_i;
     int i;
@@ -1085,21 +1862,27 @@ expect_info(interp,ecmd,argc,argv)
     int all = FALSE;		/* report on all fds */
     char *chanId = NULL;
     struct exp_f *f;
-    char *argv0 = argv[0];
-
-    while (*argv) {
-	if (streq(argv[0],"-i") && argv[1]) {
-	    chanId = argv[1];
-	    argc-=2; argv+=2;
-	} else if (streq(argv[0],"-all")) {
+    int index;
+    static char *flags[] = {"-i", "-all", "-noindirect", (char *) NULL};
+    enum flags {INFO_I, INFO_ALL, INFO_NOINDIRECT};
+
+    for (;objc>0;objc--,objv++) {
+	if (Tcl_GetIndexFromObj((Tcl_Interp *) NULL, *objv, flags, "flag",
+				0, &index) != TCL_OK) {
+	    goto usage;
+	}
+	switch ((enum flags) index) {
+	case INFO_I:
+	    if (objc < 2) goto usage;
+	    objc--; objv++;
+	    chanId = Tcl_GetStringFromObj(*objv,(int *) NULL);
+	    break;
+	case INFO_ALL:
 	    all = TRUE;
-	    argc--; argv++;
-	} else if (streq(argv[0],"-noindirect")) {
+	    break;
+	case INFO_NOINDIRECT:
 	    direct &= ~EXP_INDIRECT;
-	    argc--; argv++;
-	} else {
-	    exp_error(interp,"usage: -info [-all | -i spawn_id]\n");
-	    return TCL_ERROR;
+	    break;
 	}
     }
 
@@ -1145,16 +1928,20 @@ expect_info(interp,ecmd,argc,argv)
     }
 
     return TCL_OK;
+
+ usage:
+    exp_error(interp,"usage: -info [-all | -i spawn_id]\n");
+    return TCL_ERROR;
 }
 
-/* Exp_ExpectGlobalCmd is invoked to process expect_before/after */
+/* Exp_ExpectGlobalObjCmd is invoked to process expect_before/after */
 /*ARGSUSED*/
 int
-Exp_ExpectGlobalCmd(clientData, interp, argc, argv)
+Exp_ExpectGlobalObjCmd(clientData, interp, objc, objv)
     ClientData clientData;
     Tcl_Interp *interp;
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
 {
     int result = TCL_OK;
     struct exp_i *exp_i, **eip;
@@ -1165,25 +1952,22 @@ Exp_ExpectGlobalCmd(clientData, interp, argc, argv)
 
     struct exp_cmd_descriptor *ecmd = (struct exp_cmd_descriptor *) clientData;
 
-    if ((argc == 2) && exp_one_arg_braced(argv[1])) {
-	return(exp_eval_with_one_arg(clientData,interp,argv));
-    } else if ((argc == 3) && streq(argv[1],"-brace")) {
-	char *new_argv[2];
-	new_argv[0] = argv[0];
-	new_argv[1] = argv[2];
-	return(exp_eval_with_one_arg(clientData,interp,new_argv));
+    if (exp_eval_with_one_objarg(clientData,interp,objc,objv,&result)) {
+	return(result);
     }
 
-    if (argc > 1 && (argv[1][0] == '-')) {
-	if (exp_flageq("info",&argv[1][1],4)) {
-	    return(expect_info(interp,ecmd,argc-2,argv+2));
+    argv0 = Tcl_GetStringFromObj(objv[0],(int *) NULL);
+    if (objc > 1) {
+	char *arg = Tcl_GetStringFromObj(objv[1],(int *) NULL);
+
+	if ((arg[0] == '-') && exp_flageq("info",arg+1,4)) {
+	    return(expect_info(interp,ecmd,objc-2,objv+2,argv0));
 	} 
     }
 
-    argv0 = argv[0];
     exp_cmd_init(&eg,ecmd->cmdtype,EXP_PERMANENT);
 
-    if (TCL_ERROR == parse_expect_args(interp,&eg,NULL,argc,argv,argv0)) {
+    if (TCL_ERROR == parse_expect_args(interp,&eg,NULL,objc,objv,argv0)) {
 	return TCL_ERROR;
     }
 
@@ -1296,6 +2080,8 @@ Exp_ExpectGlobalCmd(clientData, interp, argc, argv)
     if (eg.ecd.count) {
 	int start_index;	/* where to add new ecases in old list */
 
+	ecases_changed(&ecmd->ecd);
+
 	if (ecmd->ecd.count) {
 	    /* append to end */
 	    ecmd->ecd.cases = (struct ecase **)ckrealloc((char *)ecmd->ecd.cases, count * sizeof(struct ecase *));
@@ -1341,6 +2127,112 @@ Exp_ExpectGlobalCmd(clientData, interp, argc, argv)
     return(result);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_buffer_room --
+ *
+ *	Make sure that a full buffer's worth of chars (and a trailing
+ *	null) can follow the beginning of buffer.  Discarding chars
+ *	only moves buffer and lower up, so every so often the data has
+ *	to be moved back down to the beginning of the space allocated.
+ *	Half as much space again is allocated, so this happens at most
+ *	once per half bufferful discarded.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_buffer_room(f)
+    struct exp_f *f;
+{
+    if (f->offset + f->msize + 1 <= f->cap) return;
+
+    memmove(f->buffer - f->offset,f->buffer,f->size + 1);
+    f->buffer -= f->offset;
+    if (f->lower) {
+	memmove(f->lower - f->offset,f->lower,f->lower_valid);
+	f->lower -= f->offset;
+    }
+    f->offset = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_buffer_discard --
+ *
+ *	Remove n chars from the front of a spawn id's buffer.  The
+ *	caller is responsible for printed and echoed.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Scan positions remembered for f become stale.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+exp_buffer_discard(f,n)
+    struct exp_f *f;
+    int n;
+{
+    if (n <= 0) return;
+    if (n > f->size) n = f->size;
+
+    f->buffer += n;
+    f->offset += n;
+    f->size -= n;
+    if (f->lower) {
+	f->lower += n;
+	f->lower_valid -= n;
+	if (f->lower_valid < 0) f->lower_valid = 0;
+    }
+    exp_buffer_changed(f);
+    exp_buffer_room(f);
+    f->buffer[f->size] = '\0';
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_buffer_lower --
+ *
+ *	Bring the lowercase copy of a spawn id's buffer up to date.
+ *	Most spawn ids are never matched with -nocase, so the copy is
+ *	only allocated the first time it is needed, and only chars
+ *	that arrived since it was last brought up to date are copied.
+ *
+ * Results:
+ *	The lowercase buffer, or NULL if there is no buffer at all
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+exp_buffer_lower(f)
+    struct exp_f *f;
+{
+    if (!f->buffer) return 0;
+
+    if (!f->lower) {
+	f->lower = ckalloc((unsigned)f->cap) + f->offset;
+	f->lower_valid = 0;
+    }
+    if (f->lower_valid < f->size) {
+	exp_lowmemcpy(f->lower + f->lower_valid,f->buffer + f->lower_valid,
+		      f->size - f->lower_valid);
+	f->lower_valid = f->size;
+    }
+    f->lower[f->size] = '\0';
+    return f->lower;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1362,6 +2254,7 @@ exp_adjust(f)
     struct exp_f *f;
 {
     int new_msize;
+    int new_cap;
 
     /*
      * get the latest buffer size.  Double the user input for
@@ -1374,32 +2267,55 @@ exp_adjust(f)
      * gives "reasonable" requests)
      */
     new_msize = f->umsize*2 - 1;
-    if (new_msize != f->msize) {
-	if (!f->buffer) {
-	    /* allocate buffer space for 1st time */
-	    f->buffer = ckalloc((unsigned)new_msize+1);
-	    f->lower = ckalloc((unsigned)new_msize+1);
-	    f->size = 0;
-	} else {
-	    /* buffer already exists - resize */
+    if (new_msize == f->msize) return;
+
+    /* and half as much again, so that discarding rarely has to copy */
+    new_cap = (new_msize+1) + (new_msize+1)/2;
+
+    if (!f->buffer) {
+	/* allocate buffer space for 1st time */
+	f->buffer = ckalloc((unsigned)new_cap);
+	f->lower = 0;
+	f->lower_valid = 0;
+	f->offset = 0;
+	f->cap = new_cap;
+	f->size = 0;
+    } else {
+	/* buffer already exists - resize */
 
-	    /* if truncated, forget about some data */
-	    if (f->size > new_msize) {
-		/* copy end of buffer down */
-		memmove(f->buffer,f->buffer+(f->size - new_msize),new_msize);
-		memmove(f->lower, f->lower +(f->size - new_msize),new_msize);
-		f->size = new_msize;
+	/* if truncated, forget about some data */
+	if (f->size > new_msize) {
+	    f->printed -= f->size - new_msize;
+	    if (f->printed < 0) f->printed = 0;
+	    exp_buffer_discard(f,f->size - new_msize);
 
-		f->key = expect_key++;
-	    }
+	    f->key = expect_key++;
+	}
 
-	    f->buffer = ckrealloc(f->buffer,new_msize+1);
-	    f->lower = ckrealloc(f->lower,new_msize+1);
+	/*
+	 * Only reallocate if the space doesn't fit the new size
+	 * reasonably.  Copy just the data, not the whole space.
+	 */
+	if ((f->cap < new_cap) || (f->cap > 2*new_cap)) {
+	    char *buffer = ckalloc((unsigned)new_cap);
+
+	    memcpy(buffer,f->buffer,f->size);
+	    ckfree(f->buffer - f->offset);
+	    f->buffer = buffer;
+	    if (f->lower) {
+		char *lower = ckalloc((unsigned)new_cap);
+
+		memcpy(lower,f->lower,f->lower_valid);
+		ckfree(f->lower - f->offset);
+		f->lower = lower;
+	    }
+	    f->offset = 0;
+	    f->cap = new_cap;
 	}
-	f->msize = new_msize;
-	f->buffer[f->size] = '\0';
-	f->lower[f->size] = '\0';
     }
+    f->msize = new_msize;
+    exp_buffer_room(f);
+    f->buffer[f->size] = '\0';
 }
 
 /*
@@ -1464,21 +2380,15 @@ expect_read(interp,masters,masters_max,m,timeout,key)
 	/* the meaning of 0 from i_read means eof.  Muck with it a */
 	/* little, so that from now on it means "no new data arrived */
 	/* but it should be looked at again anyway". */
-	if (cc == 0) {
+	if (cc == 0 && Tcl_InputBlocked((*m)->channel)) {
+	    /* nothing to read after all, or nothing the channel */
+	    /* didn't consume itself (such as telnet negotiation) */
+	    f = *m;
+	} else if (cc == 0) {
 	    cc = EXP_EOF;
 	} else if (cc > 0) {
 	    f = *m;
 	    f->buffer[f->size += cc] = '\0';
-
-	    /* strip parity if requested */
-	    if (f->parity == 0) {
-		/* do it from end backwards */
-		char *p = f->buffer + f->size - 1;
-		int count = cc;
-		while (count--) {
-		    *p-- &= 0x7f;
-		}
-	    }
 	} /* else {
 	     assert(cc < 0) in which case some sort of error was
 	     encountered such as an interrupt with that forced an
@@ -1524,8 +2434,18 @@ expect_read(interp,masters,masters_max,m,timeout,key)
     else write_count = 0;
     
     if (write_count) {
+	char *lower = 0;	/* where to keep the lowercase copy */
+	int nulls;
+
+	/* strip parity if requested, and look for nulls */
+	nulls = exp_condition(f->buffer + f->printed, write_count,
+			      f->parity == 0);
+
 	if (logfile_all || (loguser && logfile)) {
-	    Tcl_Write(logfile, f->buffer + f->printed, write_count);
+	    exp_logfile_write(f->buffer + f->printed, write_count);
+	}
+	if (f->log) {
+	    exp_log_write(f->log, f->buffer + f->printed, write_count);
 	}
 	/*
 	 * don't write to user if they're seeing it already,
@@ -1541,30 +2461,53 @@ expect_read(interp,masters,masters_max,m,timeout,key)
 	    Tcl_Write(debugfile, f->buffer + f->printed, write_count);
 	}
 
+	/* the lowercase buffer is otherwise brought up to date when */
+	/* needed, but if it is being kept up, do it in the same pass */
+	if (f->lower_valid > f->printed) f->lower_valid = f->printed;
+	if (f->lower && f->lower_valid == f->printed) {
+	    lower = f->lower + f->printed;
+	}
+
 	/* remove nulls from input, since there is no way */
 	/* for Tcl to deal with such strings.  Doing it here */
 	/* lets them be sent to the screen, just in case */
 	/* they are involved in formatting operations */
-	if (f->rm_nulls) {
-	    f->size -= rm_nulls(f->buffer + f->printed,write_count);
+	if (f->rm_nulls && nulls) {
+	    f->size = f->printed + exp_squeeze(f->buffer + f->printed,
+					       write_count, lower);
+	} else if (lower) {
+	    exp_lowmemcpy(lower, f->buffer + f->printed, write_count);
 	}
 	f->buffer[f->size] = '\0';
-
-	/* copy to lowercase buffer */
-	exp_lowmemcpy(f->lower+f->printed, f->buffer+f->printed,
-		      1 + f->size - f->printed);
+	if (lower) f->lower_valid = f->size;
 
 	f->printed = f->size;	/* count'm even if not logging */
     }
     return(cc);
 }
 
-/* when buffer fills, copy second half over first and */
-/* continue, so we can do matches over multiple buffers */
-void
-exp_buffer_shuffle(interp,f,save_flags,array_name,caller_name)
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_buffer_unload --
+ *
+ *	Remove the first count chars of f's buffer, first letting the
+ *	user see them in array_name(buffer)
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	array_name(spawn_id) and array_name(buffer) are set
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+exp_buffer_unload(interp,f,count,save_flags,array_name,caller_name)
     Tcl_Interp *interp;
     struct exp_f *f;
+    int count;
     int save_flags;
     char *array_name;
     char *caller_name;
@@ -1573,9 +2516,6 @@ exp_buffer_shuffle(interp,f,save_flags,array_name,caller_name)
     char match_char;		/* place to hold char temporarily */
     /* uprooted by a NULL */
 
-    int first_half = f->size/2;
-    int second_half = f->size - first_half;
-
     /*
      * allow user to see data we are discarding
      */
@@ -1586,23 +2526,39 @@ exp_buffer_shuffle(interp,f,save_flags,array_name,caller_name)
     Tcl_SetVar2(interp,array_name,"spawn_id",spawn_id,save_flags);
 
     /* temporarily null-terminate buffer in middle */
-    match_char = f->buffer[first_half];
-    f->buffer[first_half] = 0;
+    match_char = f->buffer[count];
+    f->buffer[count] = 0;
 
-    debuglog("%s: set %s(buffer) \"%s\"\r\n",
-	     caller_name,array_name,dprintify(f->buffer));
+    if (EXP_DEBUGGING) {
+	debuglog("%s: set %s(buffer) \"",caller_name,array_name);
+	exp_debuglog_printify(f->buffer,count);
+	debuglog("\"\r\n");
+    }
     Tcl_SetVar2(interp,array_name,"buffer",f->buffer,save_flags);
 
     /* remove middle-null-terminator */
-    f->buffer[first_half] = match_char;
+    f->buffer[count] = match_char;
 
-    memcpy(f->buffer,f->buffer+first_half,second_half);
-    memcpy(f->lower, f->lower +first_half,second_half);
-    f->size = second_half;
-    f->printed -= first_half;
+    f->stats.discarded += count;
+    exp_buffer_discard(f,count);
+    f->printed -= count;
     if (f->printed < 0) f->printed = 0;
 }
 
+/* when buffer fills, discard the first half and */
+/* continue, so we can do matches over multiple buffers */
+void
+exp_buffer_shuffle(interp,f,save_flags,array_name,caller_name)
+    Tcl_Interp *interp;
+    struct exp_f *f;
+    int save_flags;
+    char *array_name;
+    char *caller_name;
+{
+    f->stats.shuffles++;
+    exp_buffer_unload(interp,f,f->size/2,save_flags,array_name,caller_name);
+}
+
 /* map EXP_ style return value to TCL_ style return value */
 /* not defined to work on TCL_OK */
 int
@@ -1639,97 +2595,258 @@ exp_2tcl_returnvalue(x)
 /*
  *----------------------------------------------------------------------
  *
- * exp_i_read --
+ * exp_i_read --
+ *
+ *	Reads from the input channel. Returns # of chars read or
+ *	(non-positive) error of form EXP_XXX.
+ * Results:
+ *	returns 0 for end of file
+ *	If timeout is non-zero, assume the read will complete immediately
+ *	because data is known to be available.
+ *
+ * Side Effects:
+ *	Data is read from a channel
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static int
+exp_i_read(interp,f,timeout,save_flags)
+    Tcl_Interp *interp;
+    struct exp_f *f;
+    int timeout;
+    int save_flags;
+{
+    int nread;
+
+    if (f->size == f->msize) 
+	exp_buffer_shuffle(interp,f,save_flags,EXPECT_OUT,"expect");
+
+    nread = Tcl_Read(f->channel, f->buffer+f->size, f->msize-f->size);
+    if (nread == -1) {
+	i_read_errno = errno;
+    } else if (nread > 0) {
+	f->stats.reads++;
+	f->stats.read_bytes += nread;
+	/* {DWORD x; f->buffer[f->size] = 0; WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), f->buffer+f->size, nread, &x, NULL); printf("exp_i_read: Got %d bytes\n", nread);} */
+	nread = nread;
+    }
+
+    return(nread);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_get_var --
+ *
+ *	Variables predefined by expect are retrieved using this routine
+ *	which looks in the global space if they are not in the local space.
+ *	This allows the user to localize them if desired, and also to
+ *	avoid having to put "global" in procedure definitions.
+ *
+ * Results:
+ *	The value of the variable if it exists
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+exp_get_var(interp,var)
+    Tcl_Interp *interp;
+    char *var;
+{
+    char *val;
+
+    if (NULL != (val = Tcl_GetVar(interp,var,0 /* local */)))
+	return(val);
+    return(Tcl_GetVar(interp,var,TCL_GLOBAL_ONLY));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * get_timeout --
+ *
+ *	Gets the value of the 'timeout' variable
+ *
+ * Results:
+ *	The value of the variable if it exists
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+get_timeout(interp)
+    Tcl_Interp *interp;
+{
+    static int timeout = 1000*INIT_EXPECT_TIMEOUT;
+    char *t;
+
+    if (NULL != (t = exp_get_var(interp,EXPECT_TIMEOUT))) {
+	timeout = exp_msec_arg(t);
+    }
+    return(timeout);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_msec_arg --
+ *
+ *	Convert a timeout given in seconds, possibly with a fraction
+ *	such as 0.25, to milliseconds.
+ *
+ * Results:
+ *	Milliseconds, EXP_TIME_INFINITY for -1 or for anything longer
+ *	than Tcl timers can wait, or -2 (time out at once) for any
+ *	other negative value.  Like atoi, anything that is not a
+ *	number is 0.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_msec_arg(s)
+    char *s;
+{
+    double seconds = strtod(s,(char **)0);
+
+    if (seconds == -1) return EXP_TIME_INFINITY;
+    if (seconds < 0) return -2;
+    /* about 24 days; "set timeout 99999999" means wait indefinitely */
+    if (seconds >= 0x7fffffff/1000) return EXP_TIME_INFINITY;
+    return (int)(seconds*1000 + 0.5);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_msec_add --
  *
- *	Reads from the input channel. Returns # of chars read or
- *	(non-positive) error of form EXP_XXX.
- * Results:
- *	returns 0 for end of file
- *	If timeout is non-zero, assume the read will complete immediately
- *	because data is known to be available.
+ *	Add a timeout to a reading of exp_msec, to find when it runs
+ *	out.  A long may be only 32 bits, so the sum stops at the
+ *	largest long rather than wrapping around to the past.
  *
- * Side Effects:
- *	Data is read from a channel
+ * Results:
+ *	The exp_msec reading at which the timeout expires
  *
  *----------------------------------------------------------------------
  */
 
-/*ARGSUSED*/
-static int
-exp_i_read(interp,f,timeout,save_flags)
-    Tcl_Interp *interp;
-    struct exp_f *f;
+long
+exp_msec_add(now,timeout)
+    long now;
     int timeout;
-    int save_flags;
 {
-    int nread;
-
-    if (f->size == f->msize) 
-	exp_buffer_shuffle(interp,f,save_flags,EXPECT_OUT,"expect");
-
-    nread = Tcl_Read(f->channel, f->buffer+f->size, f->msize-f->size);
-    if (nread == -1) {
-	i_read_errno = errno;
-    } else {
-	/* {DWORD x; f->buffer[f->size] = 0; WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), f->buffer+f->size, nread, &x, NULL); printf("exp_i_read: Got %d bytes\n", nread);} */
-	nread = nread;
-    }
-
-    return(nread);
+    if (timeout > LONG_MAX - now) return LONG_MAX;
+    return now + timeout;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * exp_get_var --
+ * exp_msec --
  *
- *	Variables predefined by expect are retrieved using this routine
- *	which looks in the global space if they are not in the local space.
- *	This allows the user to localize them if desired, and also to
- *	avoid having to put "global" in procedure definitions.
+ *	Read the clock that timeouts are measured with.  Where there
+ *	is one, this is a monotonic clock, so that setting the date
+ *	doesn't make timeouts expire early or late.
  *
  * Results:
- *	The value of the variable if it exists
+ *	Milliseconds since the first call
  *
  *----------------------------------------------------------------------
  */
 
-char *
-exp_get_var(interp,var)
-    Tcl_Interp *interp;
-    char *var;
+long
+exp_msec()
 {
-    char *val;
-
-    if (NULL != (val = Tcl_GetVar(interp,var,0 /* local */)))
-	return(val);
-    return(Tcl_GetVar(interp,var,TCL_GLOBAL_ONLY));
+    static int started = FALSE;
+#ifdef __WIN32__
+    static DWORD base;
+    DWORD now = GetTickCount();
+
+    if (!started) {
+	base = now;
+	started = TRUE;
+    }
+    return (long)(now - base);
+#else
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    static struct timespec base;
+    struct timespec now;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC,&now)) {
+	if (!started) {
+	    base = now;
+	    started = TRUE;
+	}
+	return (now.tv_sec - base.tv_sec)*1000
+	    + (now.tv_nsec - base.tv_nsec)/1000000;
+    }
+#endif
+    {
+	static Tcl_Time tbase;
+	Tcl_Time tnow;
+
+	TclpGetTime(&tnow);
+	if (!started) {
+	    tbase = tnow;
+	    started = TRUE;
+	}
+	return (tnow.sec - tbase.sec)*1000 + (tnow.usec - tbase.usec)/1000;
+    }
+#endif /* __WIN32__ */
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * get_timeout --
+ * exp_usec --
  *
- *	Gets the value of the 'timeout' variable
+ *	Read the finest clock there is, for timing pattern matching.
+ *	On NT, the time of day only moves in ticks of several
+ *	milliseconds, so the performance counter is used.
  *
  * Results:
- *	The value of the variable if it exists
+ *	Microseconds since some fixed point in the past
  *
  *----------------------------------------------------------------------
  */
 
-static int
-get_timeout(interp)
-    Tcl_Interp *interp;
+double
+exp_usec()
 {
-    static int timeout = INIT_EXPECT_TIMEOUT;
-    char *t;
+#ifdef __WIN32__
+    static double ticks_per_usec = 0;
+    LARGE_INTEGER now;
 
-    if (NULL != (t = exp_get_var(interp,EXPECT_TIMEOUT))) {
-	timeout = atoi(t);
+    if (ticks_per_usec == 0) {
+	LARGE_INTEGER freq;
+
+	if (QueryPerformanceFrequency(&freq) && freq.QuadPart > 0) {
+	    ticks_per_usec = (double)freq.QuadPart / 1000000.0;
+	} else {
+	    ticks_per_usec = -1;
+	}
     }
-    return(timeout);
+    if (ticks_per_usec > 0 && QueryPerformanceCounter(&now)) {
+	return (double)now.QuadPart / ticks_per_usec;
+    }
+    return (double)GetTickCount() * 1000.0;
+#else
+    Tcl_Time tnow;
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC,&now)) {
+	return (double)now.tv_sec*1000000.0 + now.tv_nsec/1000;
+    }
+#endif
+    TclpGetTime(&tnow);
+    return (double)tnow.sec*1000000.0 + tnow.usec;
+#endif /* __WIN32__ */
 }
 
 /* make a copy of a linked list (1st arg) and attach to end of another (2nd
@@ -1963,6 +3080,7 @@ exp_background_filehandler(clientData,mask)
     struct exp_f *last_f;	/* for differentiating when multiple f's
 				 * to print out better debugging messages */
     int last_case;		/* as above but for case */
+    double started;		/* exp_usec when matching began */
     
     /* restore our environment */
     f = (struct exp_f *) clientData;
@@ -2009,12 +3127,14 @@ exp_background_filehandler(clientData,mask)
 	cc = EXP_NOMATCH;
     }
     
+    started = exp_usec();
     cc = eval_cases(interp,&exp_cmds[EXP_CMD_BEFORE],
 		    f,&eo,&last_f,&last_case,cc,&f,1,"_background");
     cc = eval_cases(interp,&exp_cmds[EXP_CMD_BG],
 		    f,&eo,&last_f,&last_case,cc,&f,1,"_background");
     cc = eval_cases(interp,&exp_cmds[EXP_CMD_AFTER],
 		    f,&eo,&last_f,&last_case,cc,&f,1,"_background");
+    f->stats.match_usec += (long)(exp_usec() - started);
     if (cc == EXP_TCLERROR) {
 	/* only likely problem here is some internal regexp botch */
 	Tcl_BackgroundError(interp);
@@ -2035,8 +3155,11 @@ exp_background_filehandler(clientData,mask)
     }
     
  matched:
-#define out(i,val)  debuglog("expect_background: set %s(%s) \"%s\"\r\n",EXPECT_OUT,i, \
-			     dprintify(val)); \
+#define out(i,val)  if (EXP_DEBUGGING) { \
+	debuglog("expect_background: set %s(%s) \"",EXPECT_OUT,i); \
+	exp_debuglog_printify(val,-1); \
+	debuglog("\"\r\n"); \
+     } \
      Tcl_SetVar2(interp,EXPECT_OUT,i,val,TCL_GLOBAL_ONLY);
  {
      /*		int iwrite = FALSE;*/	/* write spawn_id? */
@@ -2157,14 +3280,8 @@ exp_background_filehandler(clientData,mask)
 	 /* "!e" means no case matched - transfer by default */
 	 if (!e || e->transfer) {
 	     /* delete matched chars from input buffer */
-	     f->size -= match;
 	     f->printed -= match;
-	     if (f->size != 0) {
-		 memmove(f->buffer,f->buffer+match,f->size);
-		 memmove(f->lower,f->lower+match,f->size);
-	     }
-	     f->buffer[f->size] = '\0';
-	     f->lower[f->size] = '\0';
+	     exp_buffer_discard(f,match);
 	 }
 
 	 if (cc == EXP_EOF) {
@@ -2210,7 +3327,329 @@ exp_background_filehandler(clientData,mask)
 /*
  *----------------------------------------------------------------------
  *
- * Exp_ExpectCmd --
+ * ecases_unmatchable --
+ *
+ *	Find how much of the front of f's buffer none of a set of cases
+ *	can match any more, as recorded by their last searches of it.
+ *
+ * Results:
+ *	The smaller of limit and that length.  0 if any case that
+ *	applies to f hasn't searched the current buffer, is anchored
+ *	to the beginning of the buffer, or is full_buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ecases_unmatchable(ecd,f,limit)
+    struct exp_cases_descriptor *ecd;
+    struct exp_f *f;
+    int limit;
+{
+    int i;
+
+    for (i=0;(i<ecd->count) && (limit > 0);i++) {
+	struct ecase *e = ecd->cases[i];
+	struct exp_fs_list *fsl;
+
+	if (e->use == PAT_TIMEOUT ||
+	    e->use == PAT_DEFAULT ||
+	    e->use == PAT_EOF) continue;
+
+	for (fsl = e->i_list->fs_list; fsl; fsl = fsl->next) {
+	    if (fsl->f == NULL || fsl->f == exp_f_any || fsl->f == f) break;
+	}
+	if (!fsl) continue;
+
+	/* a ^ would match at the new beginning of the buffer */
+	if ((e->use == PAT_FULLBUFFER)
+	    || ((e->use == PAT_GLOB) && (e->pat[0] == '^'))
+	    || ((e->use == PAT_RE) && exp_reghasbol(e->re))
+	    || (e->scan_f != f) || (e->scan_gen != f->generation)) {
+	    return 0;
+	}
+	if (e->scan_start < limit) limit = e->scan_start;
+    }
+    return limit;
+}
+
+static void
+ecases_rebase(ecd,f,generation,count)
+    struct exp_cases_descriptor *ecd;
+    struct exp_f *f;
+    int generation;		/* of the buffer before count chars */
+    int count;			/* were removed from its front */
+{
+    int i;
+
+    for (i=0;i<ecd->count;i++) {
+	struct ecase *e = ecd->cases[i];
+
+	if ((e->scan_f == f) && (e->scan_gen == generation)) {
+	    e->scan_gen = f->generation;
+	    e->scan_start -= count;
+	    if (e->scan_start < 0) e->scan_start = 0;
+	}
+    }
+}
+
+/*
+ * With expect -lazy, the parts of expect_out that describe the match
+ * are only set when the script reads them.  The match is kept in a
+ * lazy_out attached to expect_out by a variable trace, and each
+ * element is set from it by the trace on its first read.
+ */
+
+#define LAZY_STRING	1
+#define LAZY_START	2
+#define LAZY_END	4
+
+struct lazy_out {
+    char *buffer;		/* copy of the chars matched, null-terminated */
+    char *lower;		/* lowercase copy, if a -nocase regexp matched */
+    char *sub;			/* buffer or lower, whichever was matched */
+    int space;			/* space allocated for buffer and lower */
+    int buffer_pending;		/* if expect_out(buffer) is still to be set */
+    int pending[NSUBEXP];	/* LAZY_ bits of N,... still to be set */
+    int start[NSUBEXP];		/* offsets of each N,string in sub */
+    int end[NSUBEXP];
+};
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * lazy_out_trace --
+ *
+ *	Variable trace on expect_out.  A read of an element that is
+ *	pending sets it from the lazy_out; a write or unset means
+ *	the element is no longer wanted from it.
+ *
+ * Results:
+ *	Always NULL
+ *
+ * Side Effects:
+ *	The element read may be set.  The lazy_out is freed along with
+ *	expect_out.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static char *
+lazy_out_trace(clientData,interp,name1,name2,flags)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    char *name1;
+    char *name2;
+    int flags;
+{
+    struct lazy_out *lo = (struct lazy_out *)clientData;
+    char value[20];
+    char *val;
+    char *s;
+    char c;
+    int i, bit;
+
+    if (flags & TCL_TRACE_DESTROYED) {
+	if (lo->buffer) ckfree(lo->buffer);
+	if (lo->lower) ckfree(lo->lower);
+	ckfree((char *)lo);
+	return NULL;
+    }
+    if (!name2) return NULL;
+
+    if (streq(name2,"buffer")) {
+	if (!lo->buffer_pending) return NULL;
+	lo->buffer_pending = FALSE;
+	if (!(flags & TCL_TRACE_READS)) return NULL;
+	val = lo->buffer;
+    } else {
+	if (!isdigit(*name2)) return NULL;
+	i = atoi(name2);
+	if (i >= NSUBEXP) return NULL;
+	s = strchr(name2,',');
+	if (!s) return NULL;
+	s++;
+	if (streq(s,"string")) bit = LAZY_STRING;
+	else if (streq(s,"start")) bit = LAZY_START;
+	else if (streq(s,"end")) bit = LAZY_END;
+	else return NULL;
+
+	if (!(lo->pending[i] & bit)) return NULL;
+	lo->pending[i] &= ~bit;
+	if (!(flags & TCL_TRACE_READS)) return NULL;
+
+	if (bit == LAZY_START) {
+	    sprintf(value,"%d",lo->start[i]);
+	    val = value;
+	} else if (bit == LAZY_END) {
+	    sprintf(value,"%d",lo->end[i] - 1);
+	    val = value;
+	} else val = 0;
+    }
+
+    if (val) {
+	if (EXP_DEBUGGING) {
+	    debuglog("expect: set %s(%s) \"",EXPECT_OUT,name2);
+	    exp_debuglog_printify(val,-1);
+	    debuglog("\"\r\n");
+	}
+	Tcl_SetVar2(interp,name1,name2,val,flags & TCL_GLOBAL_ONLY);
+	return NULL;
+    }
+
+    /* string itself */
+    /* temporarily null-terminate in middle */
+    s = lo->sub + lo->end[i];
+    c = *s;
+    *s = 0;
+    if (EXP_DEBUGGING) {
+	debuglog("expect: set %s(%s) \"",EXPECT_OUT,name2);
+	exp_debuglog_printify(lo->sub + lo->start[i],-1);
+	debuglog("\"\r\n");
+    }
+    Tcl_SetVar2(interp,name1,name2,lo->sub + lo->start[i],
+		flags & TCL_GLOBAL_ONLY);
+    *s = c;
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * lazy_out_match --
+ *
+ *	Record the match of e against f for expect -lazy, in place of
+ *	setting the expect_out elements that describe it.  buffer and
+ *	match are as in Exp_ExpectObjCmd.
+ *
+ * Results:
+ *	The # of chars of f's buffer taken up by the match.
+ *
+ * Side Effects:
+ *	expect_out is given a lazy_out if it had none.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+lazy_out_match(interp,e,f,buffer,match)
+    Tcl_Interp *interp;
+    struct ecase *e;
+    struct exp_f *f;
+    char *buffer;
+    int match;
+{
+    struct lazy_out *lo;
+    int i;
+
+    lo = (struct lazy_out *)Tcl_VarTraceInfo2(interp,EXPECT_OUT,
+			(char *)NULL,0,lazy_out_trace,(ClientData)NULL);
+    if (!lo) {
+	lo = (struct lazy_out *)ckalloc(sizeof(struct lazy_out));
+	lo->buffer = lo->lower = 0;
+	lo->space = 0;
+	Tcl_TraceVar2(interp,EXPECT_OUT,(char *)NULL,
+		TCL_TRACE_READS|TCL_TRACE_WRITES|TCL_TRACE_UNSETS,
+		lazy_out_trace,(ClientData)lo);
+    }
+    for (i=0;i<NSUBEXP;i++) lo->pending[i] = 0;
+    lo->sub = 0;
+
+    if (e && e->use == PAT_RE) {
+	regexp *re = e->re;
+
+	for (i=0;i<NSUBEXP;i++) {
+	    if (re->startp[i] == 0) continue;
+	    lo->start[i] = re->startp[i]-buffer;
+	    lo->end[i] = re->endp[i]-buffer;
+	    lo->pending[i] = LAZY_STRING;
+	    if (e->indices) lo->pending[i] |= LAZY_START|LAZY_END;
+	}
+	match = re->endp[0]-buffer;
+	if (buffer != f->buffer) lo->sub = buffer;
+    } else if (e && (e->use == PAT_GLOB || e->use == PAT_EXACT)) {
+	lo->start[0] = e->simple_start;
+	lo->end[0] = e->simple_start + match;
+	lo->pending[0] = LAZY_STRING;
+	if (e->indices) lo->pending[0] |= LAZY_START|LAZY_END;
+	match += e->simple_start;
+    } else if (e && e->use == PAT_NULL && e->indices) {
+	lo->start[0] = match-1;
+	lo->end[0] = match;
+	lo->pending[0] = LAZY_START|LAZY_END;
+    } else if (e && e->use == PAT_FULLBUFFER) {
+	debuglog("expect: full buffer\r\n");
+    }
+
+    /* save buf[0..match] */
+    if (match+1 > lo->space) {
+	if (lo->buffer) ckfree(lo->buffer);
+	if (lo->lower) ckfree(lo->lower);
+	lo->space = match+1;
+	lo->buffer = ckalloc(lo->space);
+	lo->lower = 0;
+    }
+    memcpy(lo->buffer,f->buffer,match);
+    lo->buffer[match] = 0;
+    if (lo->sub) {
+	/* the subexpressions are in the lowercased data */
+	if (!lo->lower) lo->lower = ckalloc(lo->space);
+	memcpy(lo->lower,lo->sub,match);
+	lo->lower[match] = 0;
+	lo->sub = lo->lower;
+    } else lo->sub = lo->buffer;
+    lo->buffer_pending = TRUE;
+
+    return match;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expect_discard --
+ *
+ *	Implements expect -discard.  Output at the front of f's buffer
+ *	that none of the patterns of the expect command (including those
+ *	of expect_before and expect_after) can match any more is removed
+ *	right away, rather than being kept until the buffer fills.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	expect_out(buffer) is set to the data removed, as when the
+ *	buffer fills.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+expect_discard(interp,eg,f)
+    Tcl_Interp *interp;
+    struct exp_cmd_descriptor *eg;
+    struct exp_f *f;
+{
+    int count = f->size;
+    int generation = f->generation;
+
+    count = ecases_unmatchable(&exp_cmds[EXP_CMD_BEFORE].ecd,f,count);
+    count = ecases_unmatchable(&eg->ecd,f,count);
+    count = ecases_unmatchable(&exp_cmds[EXP_CMD_AFTER].ecd,f,count);
+    if (count <= 0) return;
+
+    exp_buffer_unload(interp,f,count,0,EXPECT_OUT,"expect");
+
+    /* what the cases already ruled out stays ruled out */
+    ecases_rebase(&exp_cmds[EXP_CMD_BEFORE].ecd,f,generation,count);
+    ecases_rebase(&eg->ecd,f,generation,count);
+    ecases_rebase(&exp_cmds[EXP_CMD_AFTER].ecd,f,generation,count);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_ExpectObjCmd --
  *
  *	Implements the 'expect', 'expect_user', and 'expect_tty'
  *	commands.
@@ -2230,11 +3669,11 @@ exp_background_filehandler(clientData,mask)
 
 /*ARGSUSED*/
 int
-Exp_ExpectCmd(clientData, interp, argc, argv)
+Exp_ExpectObjCmd(clientData, interp, objc, objv)
     ClientData clientData;
     Tcl_Interp *interp;
-    int argc;
-    char **argv;
+    int objc;
+    Tcl_Obj *CONST objv[];
 {
     int cc;			/* number of chars returned in a single read
 				 * or negative EXP_whatever */
@@ -2254,7 +3693,7 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
     time_t start_time_total;	/* time at beginning of this procedure */
     time_t start_time = 0;	/* time when restart label hit */
     time_t current_time = 0;	/* current time (when we last looked)*/
-    time_t end_time;		/* future time at which to give up */
+    long end_time;		/* exp_msec at which to give up */
     time_t elapsed_time_total;	/* time from now to match/fail/timeout */
     time_t elapsed_time;	/* time from restart to (ditto) */
 
@@ -2262,25 +3701,21 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 				 * to print out better debugging messages */
     int last_case;		/* as above but for case */
     int first_time = 1;		/* if not "restarted" */
+    double started;		/* exp_usec when matching began */
 
     int key;			/* identify this expect command instance */
     int configure_count;	/* monitor exp_configure_count */
 
-    int timeout;		/* seconds */
+    int timeout;		/* milliseconds */
     int remtime;		/* remaining time in timeout */
     int reset_timer;		/* should timer be reset after continue? */
     char *argv0;		/* Command name */
 
-    if ((argc == 2) && exp_one_arg_braced(argv[1])) {
-	return(exp_eval_with_one_arg(clientData,interp,argv));
-    } else if ((argc == 3) && streq(argv[1],"-brace")) {
-	char *new_argv[2];
-	new_argv[0] = argv[0];
-	new_argv[1] = argv[2];
-	return(exp_eval_with_one_arg(clientData,interp,new_argv));
+    if (exp_eval_with_one_objarg(clientData,interp,objc,objv,&result)) {
+	return(result);
     }
 
-    argv0 = argv[0];
+    argv0 = Tcl_GetStringFromObj(objv[0],(int *) NULL);
     time(&start_time_total);
     start_time = start_time_total;
     reset_timer = TRUE;
@@ -2299,7 +3734,7 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
     } else {
 	f = NULL;
     }
-    if (TCL_ERROR == parse_expect_args(interp,&eg,f,argc,argv,argv0))
+    if (TCL_ERROR == parse_expect_args_cached(interp,&eg,f,objc,objv,argv0))
 	return TCL_ERROR;
 
  restart_with_update:
@@ -2359,14 +3794,13 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
     if (timeout != EXP_TIME_INFINITY) {
 	/* if exp_continue -continue_timer, do not update end_time */
 	if (reset_timer) {
-	    time(&current_time);
-	    end_time = current_time + timeout;
+	    end_time = exp_msec_add(exp_msec(),timeout);
 	} else {
 	    reset_timer = TRUE;
 	}
     }
 
-    /* remtime and current_time updated at bottom of loop */
+    /* remtime updated at bottom of loop */
     remtime = timeout;
 
     for (;;) {
@@ -2395,12 +3829,16 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 	    last_f = 0;
 	}
 
+	started = exp_usec();
+	exp_want_resume = eg.discard;
 	cc = eval_cases(interp,&exp_cmds[EXP_CMD_BEFORE],
 			f,&eo,&last_f,&last_case,cc,masters,mcount,"");
 	cc = eval_cases(interp,&eg,
 			f,&eo,&last_f,&last_case,cc,masters,mcount,"");
 	cc = eval_cases(interp,&exp_cmds[EXP_CMD_AFTER],
 			f,&eo,&last_f,&last_case,cc,masters,mcount,"");
+	exp_want_resume = FALSE;
+	if (f) f->stats.match_usec += (long)(exp_usec() - started);
 	if (cc == EXP_TCLERROR) goto error;
 	/* special eof code that cannot be done in eval_cases */
 	/* or above, because it would then be executed several times */
@@ -2418,9 +3856,10 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 	/* no match was made with current data, force a read */
 	f->force_read = TRUE;
 
+	if (eg.discard) expect_discard(interp,&eg,f);
+
 	if (timeout != EXP_TIME_INFINITY) {
-	    time(&current_time);
-	    remtime = end_time - current_time;
+	    remtime = end_time - exp_msec();
 	}
     }
 
@@ -2429,9 +3868,12 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
  error:
     result = exp_2tcl_returnvalue(cc);
  done:
-#define out(i,val)  debuglog("expect: set %s(%s) \"%s\"\r\n",EXPECT_OUT,i, \
-			     dprintify(val)); \
-				 Tcl_SetVar2(interp,EXPECT_OUT,i,val,0);
+#define out(i,val)  if (EXP_DEBUGGING) { \
+	debuglog("expect: set %s(%s) \"",EXPECT_OUT,i); \
+	exp_debuglog_printify(val,-1); \
+	debuglog("\"\r\n"); \
+    } \
+    Tcl_SetVar2(interp,EXPECT_OUT,i,val,0);
 
     if (result != TCL_ERROR) {
 	/*		int iwrite = FALSE;*/	/* write spawn_id? */
@@ -2442,6 +3884,7 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 	char match_char;	/* place to hold char temporarily */
 	/* uprooted by a NULL */
 	char *eof_body = 0;
+	int lazy = FALSE;	/* if match is left to lazy_out_trace */
 
 	if (eo.e) {
 	    e = eo.e;
@@ -2473,7 +3916,10 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 	    buffer = eo.buffer;
 	}			
 
-	if (match >= 0) {
+	if (match >= 0 && eg.lazy && eo.f) {
+	    match = lazy_out_match(interp,e,f,buffer,match);
+	    lazy = TRUE;
+	} else if (match >= 0) {
 	    char name[20], value[20];
 
 	    if (e && e->use == PAT_RE) {
@@ -2557,25 +4003,21 @@ Exp_ExpectCmd(clientData, interp, argc, argv)
 	    out("spawn_id",spawn_id);
 	    /*			}*/
 
-	    /* save buf[0..match] */
-	    /* temporarily null-terminate string in middle */
-	    match_char = f->buffer[match];
-	    f->buffer[match] = 0;
-	    out("buffer",f->buffer);
-	    /* remove middle-null-terminator */
-	    f->buffer[match] = match_char;
+	    if (!lazy) {
+		/* save buf[0..match] */
+		/* temporarily null-terminate string in middle */
+		match_char = f->buffer[match];
+		f->buffer[match] = 0;
+		out("buffer",f->buffer);
+		/* remove middle-null-terminator */
+		f->buffer[match] = match_char;
+	    }
 
 	    /* "!e" means no case matched - transfer by default */
 	    if (!e || e->transfer) {
 		/* delete matched chars from input buffer */
-		f->size -= match;
 		f->printed -= match;
-		if (f->size != 0) {
-		    memmove(f->buffer,f->buffer+match,f->size);
-		    memmove(f->lower,f->lower+match,f->size);
-		}
-		f->buffer[f->size] = '\0';
-		f->lower[f->size] = '\0';
+		exp_buffer_discard(f,match);
 	    }
 
 	    if (cc == EXP_EOF) {
@@ -2735,19 +4177,6 @@ char **argv;
 
 }
 
-/* lowmemcpy - like memcpy but it lowercases result */
-void
-exp_lowmemcpy(dest,src,n)
-    char *dest;
-    char *src;
-    int n;
-{
-    for (;n>0;n--) {
-	*dest = ((isascii(*src) && isupper(*src))?tolower(*src):*src);
-	src++;	dest++;
-    }
-}
-
 /*ARGSUSED*/
 int
 Exp_MatchMaxCmd(clientData,interp,argc,argv)
@@ -2817,6 +4246,97 @@ Exp_MatchMaxCmd(clientData,interp,argc,argv)
     return(TCL_OK);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_StatsCmd --
+ *
+ *	Implements "expect_stats ?-reset? ?-i spawn_id?".  Reports the
+ *	counters kept for a spawn id as a list of names and values,
+ *	suitable for "array set".
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ * Side Effects:
+ *	With -reset, the counters are zeroed after being reported.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct {
+    char *name;
+    int offset;
+} stats_names[] = {
+#define EXP_STAT(x)	{#x, (int) (long) &((struct exp_stats *)0)->x}
+    EXP_STAT(reads),
+    EXP_STAT(read_bytes),
+    EXP_STAT(writes),
+    EXP_STAT(write_bytes),
+    EXP_STAT(glob),
+    EXP_STAT(re),
+    EXP_STAT(exact),
+    EXP_STAT(null),
+    EXP_STAT(full_buffer),
+    EXP_STAT(matches),
+    EXP_STAT(match_usec),
+    EXP_STAT(shuffles),
+    EXP_STAT(discarded),
+#undef EXP_STAT
+    {0}
+};
+
+/*ARGSUSED*/
+static int
+Exp_StatsCmd(clientData,interp,argc,argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    char **argv;
+{
+    struct exp_f *f;
+    int reset = FALSE;
+    char *chan = NULL;
+    char buf[20];		/* enough for a %ld */
+    int i;
+    
+    argc--; argv++;
+    
+    for (;argc>0;argc--,argv++) {
+	if (streq(*argv,"-reset")) {
+	    reset = TRUE;
+	} else if (streq(*argv,"-i")) {
+	    argc--;argv++;
+	    if (argc < 1) {
+		exp_error(interp,"-i needs argument");
+		return(TCL_ERROR);
+	    }
+	    chan = *argv;
+	} else {
+	    exp_error(interp,"usage: expect_stats ?-reset? ?-i spawn_id?");
+	    return(TCL_ERROR);
+	}
+    }
+    
+    if (chan == NULL) {
+	if (!(f = exp_update_master(interp,0,0)))
+	    return(TCL_ERROR);
+    } else {
+	if (!(f = exp_chan2f(interp,chan,0,0,"expect_stats")))
+	    return(TCL_ERROR);
+    }
+
+    for (i=0;stats_names[i].name;i++) {
+	Tcl_AppendElement(interp,stats_names[i].name);
+	sprintf(buf,"%ld",
+		*(long *)((char *)&f->stats + stats_names[i].offset));
+	Tcl_AppendElement(interp,buf);
+    }
+
+    if (reset) memset((char *)&f->stats,0,sizeof(f->stats));
+    return(TCL_OK);
+}
+
 /*ARGSUSED*/
 int
 Exp_RemoveNullsCmd(clientData,interp,argc,argv)
@@ -3033,13 +4553,14 @@ cmdX(clientData, interp, argc, argv)
 
 static struct exp_cmd_data
 cmd_data[]  = {
-{"expect",	Exp_ExpectCmd,	(ClientData) NULL,	0},
-{"expect_after",Exp_ExpectGlobalCmd,(ClientData)&exp_cmds[EXP_CMD_AFTER],0},
-{"expect_before",Exp_ExpectGlobalCmd,(ClientData)&exp_cmds[EXP_CMD_BEFORE],0},
-{"expect_user",	Exp_ExpectCmd,	(ClientData)"exp_user",	0},
-{"expect_tty",	Exp_ExpectCmd,	(ClientData)"exp_tty",	0},
-{"expect_background",Exp_ExpectGlobalCmd,(ClientData)&exp_cmds[EXP_CMD_BG],0},
+{"expect",	0,	(ClientData) NULL,	0,	Exp_ExpectObjCmd},
+{"expect_after",0,(ClientData)&exp_cmds[EXP_CMD_AFTER],0,Exp_ExpectGlobalObjCmd},
+{"expect_before",0,(ClientData)&exp_cmds[EXP_CMD_BEFORE],0,Exp_ExpectGlobalObjCmd},
+{"expect_user",	0,	(ClientData)"exp_user",	0,	Exp_ExpectObjCmd},
+{"expect_tty",	0,	(ClientData)"exp_tty",	0,	Exp_ExpectObjCmd},
+{"expect_background",0,(ClientData)&exp_cmds[EXP_CMD_BG],0,Exp_ExpectGlobalObjCmd},
 {"match_max",	Exp_MatchMaxCmd,	0,	0},
+{"expect_stats",Exp_StatsCmd,		0,	0},
 {"remove_nulls",Exp_RemoveNullsCmd,	0,	0},
 {"parity",	Exp_ParityCmd,		0,	0},
 {"timestamp",	Exp_TimestampCmd,	0,	0},
@@ -3075,6 +4596,8 @@ exp_init_expect_cmds(interp)
     exp_cmd_init(&exp_cmds[EXP_CMD_BG    ],EXP_CMD_BG,    EXP_PERMANENT);
     exp_cmd_init(&exp_cmds[EXP_CMD_FG    ],EXP_CMD_FG,    EXP_TEMPORARY);
 
+    Tcl_InitHashTable(&case_cache,TCL_STRING_KEYS);
+
     /* preallocate to one element, so future realloc's work */
     exp_cmds[EXP_CMD_BEFORE].ecd.cases = 0;
     exp_cmds[EXP_CMD_AFTER ].ecd.cases = 0;
@@ -88,6 +88,7 @@ EXTERN DLLIMP char *exp_match;		/* start of matched string */
 EXTERN DLLIMP char *exp_match_end;	/* one beyond end of matched string */
 EXTERN DLLIMP int exp_match_max;	/* bytes */
 EXTERN DLLIMP int exp_timeout;		/* seconds */
+EXTERN DLLIMP int exp_timeout_msec;	/* if not -1, overrides exp_timeout */
 EXTERN DLLIMP int exp_full_buffer;	/* if true, return on full buffer */
 EXTERN DLLIMP int exp_remove_nulls;	/* if true, remove nulls */
 
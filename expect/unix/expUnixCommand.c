@@ -75,6 +75,109 @@ exp_getpidproc()
     return getpid();
 }
 
+#ifdef HAVE_VFORK
+#define exp_vfork	vfork
+#else
+#define exp_vfork	fork
+#endif
+
+static int pty_pool_scheduled = FALSE;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * pty_pool_idle --
+ *
+ *	Idle callback that gets the next pty of spawn -fast ready
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*ARGSUSED*/
+static void
+pty_pool_idle(clientData)
+    ClientData clientData;
+{
+    pty_pool_scheduled = FALSE;
+    (void) exp_pty_pool_fill();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * spawn_fast --
+ *
+ *	Starts a process for spawn -fast.  The pty has been set up in
+ *	this process already, so the child has only to make it its
+ *	controlling terminal and exec.  Being a vfork child, it shares
+ *	our memory and must stick to system calls.
+ *
+ * Results:
+ *	The process id, or -1 with errno set if the fork or the exec
+ *	failed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+spawn_fast(argv,slave,ignore)
+    char **argv;
+    int slave;
+    int *ignore;
+{
+    int status_pipe[2];
+    int child_errno;
+    int pid, rc, i;
+
+    if (-1 == pipe(status_pipe)) return(-1);
+    exp_close_on_exec(status_pipe[0]);
+    exp_close_on_exec(status_pipe[1]);
+
+    if ((pid = exp_vfork()) == -1) {
+	child_errno = errno;
+	close(status_pipe[0]);
+	close(status_pipe[1]);
+	errno = child_errno;
+	return(-1);
+    }
+
+    if (pid == 0) {
+	if (exp_dev_tty != -1) close(exp_dev_tty);
+	setsid();
+#if defined(TIOCSCTTY) && !defined(sun) && !defined(hpux)
+	(void) ioctl(slave,TIOCSCTTY,(char *)0);
+#else
+	/* the first tty a session leader opens becomes its own */
+	close(open(exp_pty_slave_name,O_RDWR));
+#endif
+	dup2(slave,0);
+	dup2(slave,1);
+	dup2(slave,2);
+	for (i=1;i<NSIG;i++) {
+	    signal(i,ignore[i]?SIG_IGN:SIG_DFL);
+	}
+	(void) execvp(argv[0],argv);
+	/* if exec failed, communicate the reason back to the parent */
+	write(status_pipe[1], &errno, sizeof errno);
+	_exit(-1);
+	/*NOTREACHED*/
+    }
+
+    close(status_pipe[1]);
+    while (((rc = read(status_pipe[0],&child_errno,sizeof child_errno)) < 0)
+	   && (errno == EINTR)) {
+	/* empty */;
+    }
+    close(status_pipe[0]);
+    if (rc > 0) {
+	/* child's exec failed */
+	waitpid(pid, NULL, 0);
+	errno = child_errno;
+	return(-1);
+    }
+    return(pid);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -117,6 +220,7 @@ char **argv;
 	int echo = TRUE;
 	int console = FALSE;
 	int pty_only = FALSE;
+	int fast = FALSE;	/* set up pty here and vfork */
 
 #ifdef FULLTRAPS
 				/* Allow user to reset signals in child */
@@ -178,6 +282,8 @@ char **argv;
 			console = TRUE;
 		} else if (streq(*argv,"-pty")) {
 			pty_only = TRUE;
+		} else if (streq(*argv,"-fast")) {
+			fast = TRUE;
 		} else if (streq(*argv,"-open")) {
 			if (argc < 2) {
 				exp_error(interp,"usage: -open file-identifier");
@@ -261,6 +367,12 @@ char **argv;
 		return(TCL_ERROR);
 	}
 
+	/* these need the child to do more than the fast path allows */
+	if (pty_only || openarg || console) fast = FALSE;
+#if defined(FULLTRAPS) || defined(HAVE_PTYTRAP) || defined(CRAY)
+	fast = FALSE;
+#endif
+
 	stty_init = exp_get_var(interp,STTY_INIT);
 	if (stty_init) {
 		slave_write_ioctls++;
@@ -287,7 +399,12 @@ when trapping, see below in child half of fork */
 			exp_nflog("\r\n",0);
 		}
 
-		if (0 > (master = getptymaster())) {
+		if (fast) {
+			master = exp_getptypair(&slave,ttycopy,ttyinit,stty_init);
+		} else {
+			master = getptymaster();
+		}
+		if (0 > master) {
 			/*
 			 * failed to allocate pty, try and figure out why
 			 * so we can suggest to user what to do about it.
@@ -489,9 +606,42 @@ when trapping, see below in child half of fork */
 	}
 
 	if (NULL == (argv[0] = Tcl_TildeSubst(interp,argv[0],&dstring))) {
+		if (fast) close(slave);
 		goto parent_error;
 	}
 
+	if (fast) {
+		struct exp_f *f;
+
+		pid = spawn_fast(argv,slave,ignore);
+		close(slave);
+		if (pid == -1) {
+			exp_error(interp, "couldn't execute \"%s\": %s",
+				argv[0],Tcl_PosixError(interp));
+			close(master);
+			goto parent_error;
+		}
+
+		f = fd_new(master,pid);
+		if (exp_pty_slave_name) set_slave_name(f,exp_pty_slave_name);
+
+		/* get the next pty ready while nothing else is going on */
+		if (!pty_pool_scheduled) {
+			pty_pool_scheduled = TRUE;
+			Tcl_DoWhenIdle(pty_pool_idle,(ClientData)0);
+		}
+
+		/* tell user id of new process */
+		sprintf(buf,"%d",master);
+		Tcl_SetVar(interp,EXP_SPAWN_ID_VARNAME,buf,0);
+
+		sprintf(interp->result,"%d",pid);
+		debuglog("spawn: returns {%s}\r\n",interp->result);
+
+		Tcl_DStringFree(&dstring);
+		return(TCL_OK);
+	}
+
 	if (-1 == pipe(sync_fds)) {
 		exp_error(interp,"too many programs spawned?  could not create pipe: %s",Tcl_PosixError(interp));
 		goto parent_error;
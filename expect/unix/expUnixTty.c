@@ -371,6 +371,8 @@ char **argv;
 	int fd;			/* (slave) fd of infile */
 	int master = -1;	/* master fd of infile */
 	char **argv0 = argv;
+	exp_tty tty;		/* modes of infile */
+	int n;
 
 	for (argv=argv0+1;*argv;argv++) {
 		if (argv[0][0] == '<') {
@@ -441,6 +443,10 @@ char **argv;
 					exp_win_columns_get(interp->result);
 					return TCL_OK;
 				}
+			} else if ((n = exp_stty_arg(&tty_current,argv)) > 0) {
+				argv += n-1;
+				saw_known_stty_arg = TRUE;
+				no_args = FALSE;
 			} else {
 				saw_unknown_stty_arg = TRUE;
 			}
@@ -484,7 +490,15 @@ char **argv;
 		char *redirect_save = *redirect;
 		*redirect = 0;
 
-		for (argv=argv0+1;*argv;argv++) {
+#ifdef HAVE_TCSETATTR
+		if (-1 == tcgetattr(fd, &tty)) {
+#else
+		if (-1 == ioctl(fd, TCGETS, (char *)&tty)) {
+#endif
+			saw_unknown_stty_arg = TRUE;
+		}
+
+		for (argv=argv0+1;*argv && !saw_unknown_stty_arg;argv++) {
 			if (streq(*argv,"rows")) {
 				if (*(argv+1)) {
 					exp_win2_rows_set(fd,*(argv+1));
@@ -505,6 +519,10 @@ char **argv;
 				}
 			} else if (streq(*argv,"<")) {
 				break;
+			} else if ((n = exp_stty_arg(&tty,argv)) > 0) {
+				argv += n-1;
+				saw_known_stty_arg = TRUE;
+				no_args = FALSE;
 			} else {
 				saw_unknown_stty_arg = TRUE;
 				break;
@@ -514,6 +532,18 @@ char **argv;
 		/* restore redirect */
 		*redirect = redirect_save;
 
+		if (saw_known_stty_arg && !saw_unknown_stty_arg) {
+#ifdef HAVE_TCSETATTR
+			if (-1 == tcsetattr(fd, TCSADRAIN, &tty)) {
+#else
+			if (-1 == ioctl(fd, TCSETSW, (char *)&tty)) {
+#endif
+				exp_error(interp,"stty: ioctl(%s): %s",infile,
+					Tcl_PosixError(interp));
+				rc = TCL_ERROR;
+			}
+		}
+
 		close(fd);	/* no more use for this, from now on */
 				/* pass by name */
 
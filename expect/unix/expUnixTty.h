@@ -23,6 +23,9 @@ void exp_tty_set();
 int exp_tty_set_simple();
 int exp_tty_get_simple();
 
+int exp_stty_arg();
+int exp_stty_args();
+
 #include "exp_tty_in.h"
 
 #endif	/* __EXP_UNIX_TTY_H__ */
@@ -13,5 +13,7 @@ void exp_pty_test_end();
 int exp_pty_test();
 void exp_pty_unlock();
 int exp_pty_lock();
+int exp_getptypair();
+int exp_pty_pool_fill();
 
 extern char *exp_pty_slave_name;
@@ -368,7 +368,7 @@ Tcl_Interp *interp;
 int *masters;
 int n;			/* # of masters */
 int *master_out;	/* 1st event master, not set if none */
-int timeout;		/* seconds */
+int timeout;		/* milliseconds */
 int key;
 {
 	int m;
@@ -34,3 +34,337 @@ exp_init_tty()
 	tty_current = exp_tty_original;
 }
 
+
+/* stty(1) arguments understood without running stty.  This covers */
+/* the modes, special characters and combinations that scripts and */
+/* stty_init commonly use.  Anything else (speeds, rows, columns, */
+/* vendor oddities) is left for the real stty. */
+
+#if defined(HAVE_TERMIOS) || defined(HAVE_TERMIO)
+
+#include <string.h>
+
+/* modes missing on this system are 0 and so aren't recognized */
+#ifndef IMAXBEL
+#define IMAXBEL 0
+#endif
+#ifndef IUCLC
+#define IUCLC 0
+#endif
+#ifndef IXANY
+#define IXANY 0
+#endif
+#ifndef ONLCR
+#define ONLCR 0
+#endif
+#ifndef OCRNL
+#define OCRNL 0
+#endif
+#ifndef ONOCR
+#define ONOCR 0
+#endif
+#ifndef ONLRET
+#define ONLRET 0
+#endif
+#ifndef OLCUC
+#define OLCUC 0
+#endif
+#ifndef CRTSCTS
+#define CRTSCTS 0
+#endif
+#ifndef IEXTEN
+#define IEXTEN 0
+#endif
+#ifndef ECHOCTL
+#define ECHOCTL 0
+#endif
+#ifndef ECHOPRT
+#define ECHOPRT 0
+#endif
+#ifndef ECHOKE
+#define ECHOKE 0
+#endif
+#ifndef XCASE
+#define XCASE 0
+#endif
+
+static struct stty_mode {
+	char *name;
+	char field;		/* i, o, c or l */
+	unsigned long mask;	/* bits cleared ... */
+	unsigned long bits;	/* ... then set */
+	int negate;		/* if "-name" clears mask */
+} stty_modes[] = {
+	{"ignbrk",	'i', IGNBRK,	IGNBRK,	1},
+	{"brkint",	'i', BRKINT,	BRKINT,	1},
+	{"ignpar",	'i', IGNPAR,	IGNPAR,	1},
+	{"parmrk",	'i', PARMRK,	PARMRK,	1},
+	{"inpck",	'i', INPCK,	INPCK,	1},
+	{"istrip",	'i', ISTRIP,	ISTRIP,	1},
+	{"inlcr",	'i', INLCR,	INLCR,	1},
+	{"igncr",	'i', IGNCR,	IGNCR,	1},
+	{"icrnl",	'i', ICRNL,	ICRNL,	1},
+	{"ixon",	'i', IXON,	IXON,	1},
+	{"ixoff",	'i', IXOFF,	IXOFF,	1},
+	{"ixany",	'i', IXANY,	IXANY,	1},
+	{"imaxbel",	'i', IMAXBEL,	IMAXBEL,	1},
+	{"iuclc",	'i', IUCLC,	IUCLC,	1},
+	{"opost",	'o', OPOST,	OPOST,	1},
+	{"onlcr",	'o', ONLCR,	ONLCR,	1},
+	{"ocrnl",	'o', OCRNL,	OCRNL,	1},
+	{"onocr",	'o', ONOCR,	ONOCR,	1},
+	{"onlret",	'o', ONLRET,	ONLRET,	1},
+	{"olcuc",	'o', OLCUC,	OLCUC,	1},
+	{"cread",	'c', CREAD,	CREAD,	1},
+	{"clocal",	'c', CLOCAL,	CLOCAL,	1},
+	{"hupcl",	'c', HUPCL,	HUPCL,	1},
+	{"cstopb",	'c', CSTOPB,	CSTOPB,	1},
+	{"parenb",	'c', PARENB,	PARENB,	1},
+	{"parodd",	'c', PARODD,	PARODD,	1},
+	{"crtscts",	'c', CRTSCTS,	CRTSCTS,	1},
+	{"cs5",		'c', CSIZE,	CS5,	0},
+	{"cs6",		'c', CSIZE,	CS6,	0},
+	{"cs7",		'c', CSIZE,	CS7,	0},
+	{"cs8",		'c', CSIZE,	CS8,	0},
+	{"isig",	'l', ISIG,	ISIG,	1},
+	{"icanon",	'l', ICANON,	ICANON,	1},
+	{"iexten",	'l', IEXTEN,	IEXTEN,	1},
+	{"echo",	'l', ECHO,	ECHO,	1},
+	{"echoe",	'l', ECHOE,	ECHOE,	1},
+	{"echok",	'l', ECHOK,	ECHOK,	1},
+	{"echonl",	'l', ECHONL,	ECHONL,	1},
+	{"noflsh",	'l', NOFLSH,	NOFLSH,	1},
+	{"tostop",	'l', TOSTOP,	TOSTOP,	1},
+	{"echoctl",	'l', ECHOCTL,	ECHOCTL,	1},
+	{"echoprt",	'l', ECHOPRT,	ECHOPRT,	1},
+	{"echoke",	'l', ECHOKE,	ECHOKE,	1},
+	{"xcase",	'l', XCASE,	XCASE,	1},
+	{0}
+};
+
+static struct stty_char {
+	char *name;
+	int index;
+} stty_chars[] = {
+	{"intr",	VINTR},
+	{"quit",	VQUIT},
+	{"erase",	VERASE},
+	{"kill",	VKILL},
+	{"eof",		VEOF},
+	{"eol",		VEOL},
+#ifdef VEOL2
+	{"eol2",	VEOL2},
+#endif
+#ifdef VSTART
+	{"start",	VSTART},
+#endif
+#ifdef VSTOP
+	{"stop",	VSTOP},
+#endif
+#ifdef VSUSP
+	{"susp",	VSUSP},
+#endif
+#ifdef VDSUSP
+	{"dsusp",	VDSUSP},
+#endif
+#ifdef VREPRINT
+	{"rprnt",	VREPRINT},
+#endif
+#ifdef VWERASE
+	{"werase",	VWERASE},
+#endif
+#ifdef VLNEXT
+	{"lnext",	VLNEXT},
+#endif
+#ifdef VDISCARD
+	{"discard",	VDISCARD},
+#endif
+	{0}
+};
+
+/* combinations, expanded into the above */
+static char *stty_sane[] = {
+	"cread", "-ignbrk", "brkint", "-inlcr", "-igncr", "icrnl",
+	"-ixoff", "-iuclc", "-ixany", "imaxbel", "opost", "-olcuc",
+	"-ocrnl", "onlcr", "-onocr", "-onlret", "isig", "icanon",
+	"iexten", "echo", "echoe", "echok", "-echonl", "-noflsh",
+	"-xcase", "-tostop", "-echoprt", "echoctl", "echoke",
+	"intr", "^c", "quit", "^\\", "erase", "^?", "kill", "^u",
+	"eof", "^d", "start", "^q", "stop", "^s", "susp", "^z", 0
+};
+static char *stty_raw[] = {
+	"-ignbrk", "-brkint", "-ignpar", "-parmrk", "-inpck", "-istrip",
+	"-inlcr", "-igncr", "-icrnl", "-ixon", "-ixoff", "-iuclc",
+	"-ixany", "-imaxbel", "-opost", "-isig", "-icanon", "-xcase",
+	"min", "1", "time", "0", 0
+};
+static char *stty_cooked[] = {
+	"brkint", "ignpar", "istrip", "icrnl", "ixon", "opost", "isig",
+	"icanon", 0
+};
+static char *stty_nl[] = {"-icrnl", "-onlcr", 0};
+static char *stty_nonl[] = {
+	"icrnl", "-inlcr", "-igncr", "onlcr", "-ocrnl", "-onlret", 0
+};
+static char *stty_evenp[] = {"parenb", "-parodd", "cs7", 0};
+static char *stty_oddp[] = {"parenb", "parodd", "cs7", 0};
+static char *stty_noparity[] = {"-parenb", "cs8", 0};
+static char *stty_ek[] = {"erase", "^?", "kill", "^u", 0};
+
+static struct stty_combo {
+	char *name;
+	char **on;		/* for "name" */
+	char **off;		/* for "-name" */
+} stty_combos[] = {
+	{"sane",	stty_sane,	0},
+	{"raw",		stty_raw,	stty_cooked},
+	{"cooked",	stty_cooked,	stty_raw},
+	{"nl",		stty_nl,	stty_nonl},
+	{"evenp",	stty_evenp,	stty_noparity},
+	{"parity",	stty_evenp,	stty_noparity},
+	{"oddp",	stty_oddp,	stty_noparity},
+	{"ek",		stty_ek,	0},
+	{0}
+};
+
+static void
+stty_mode_set(tty,field,mask,bits)
+exp_tty *tty;
+int field;
+unsigned long mask, bits;
+{
+	switch (field) {
+	case 'i': tty->c_iflag = (tty->c_iflag & ~mask) | bits; break;
+	case 'o': tty->c_oflag = (tty->c_oflag & ~mask) | bits; break;
+	case 'c': tty->c_cflag = (tty->c_cflag & ~mask) | bits; break;
+	case 'l': tty->c_lflag = (tty->c_lflag & ~mask) | bits; break;
+	}
+}
+
+/* parse a special char the way stty does: ^x, ^?, ^- or undef, or x */
+static int
+stty_char_value(s)
+char *s;
+{
+	if (!strcmp(s,"^-") || !strcmp(s,"undef")) {
+#ifdef _POSIX_VDISABLE
+		return _POSIX_VDISABLE;
+#else
+		return 0;
+#endif
+	}
+	if (s[0] == '^' && s[1] != '\0' && s[2] == '\0') {
+		if (s[1] == '?') return 0177;
+		return s[1] & 037;
+	}
+	if (s[0] != '\0' && s[1] == '\0') return (unsigned char)s[0];
+	return -1;
+}
+
+static int
+stty_number(s)
+char *s;
+{
+	int n = 0;
+
+	if (!*s) return -1;
+	for (;*s;s++) {
+		if (*s < '0' || *s > '9' || n > 255) return -1;
+		n = n*10 + *s - '0';
+	}
+	return (n > 255?-1:n);
+}
+
+/* Apply one stty argument (and its value, if it takes one) to *tty. */
+/* Returns the number of argv elements used, or 0 if not understood */
+/* (in which case *tty may have been partly changed). */
+int
+exp_stty_arg(tty,argv)
+exp_tty *tty;
+char **argv;
+{
+	struct stty_mode *m;
+	struct stty_char *c;
+	struct stty_combo *k;
+	char *name = argv[0];
+	int off = FALSE;
+	int n;
+
+	if (*name == '-') {
+		off = TRUE;
+		name++;
+	}
+
+	for (m=stty_modes;m->name;m++) {
+		if (strcmp(name,m->name)) continue;
+		if (m->mask == 0) return 0;	/* not on this system */
+		if (off) {
+			if (!m->negate) return 0;
+			stty_mode_set(tty,m->field,m->mask,0L);
+		} else stty_mode_set(tty,m->field,m->mask,m->bits);
+		return 1;
+	}
+
+	for (k=stty_combos;k->name;k++) {
+		char **a;
+
+		if (strcmp(name,k->name)) continue;
+		a = (off?k->off:k->on);
+		if (!a) return 0;
+		while (*a) {
+			/* modes absent from this system are skipped */
+			if (!(n = exp_stty_arg(tty,a))) n = 1;
+			a += n;
+		}
+		return 1;
+	}
+
+	if (off || !argv[1]) return 0;
+
+	for (c=stty_chars;c->name;c++) {
+		if (strcmp(name,c->name)) continue;
+		if (-1 == (n = stty_char_value(argv[1]))) return 0;
+		tty->c_cc[c->index] = n;
+		return 2;
+	}
+
+	if (!strcmp(name,"min") || !strcmp(name,"time")) {
+		if (-1 == (n = stty_number(argv[1]))) return 0;
+		tty->c_cc[name[0] == 'm'?VMIN:VTIME] = n;
+		return 2;
+	}
+	return 0;
+}
+
+#else /* no termio(s) */
+
+/*ARGSUSED*/
+int
+exp_stty_arg(tty,argv)
+exp_tty *tty;
+char **argv;
+{
+	return 0;
+}
+
+#endif /* HAVE_TERMIOS || HAVE_TERMIO */
+
+/* Apply a null-terminated list of stty arguments to *tty.  Returns */
+/* TRUE if all were understood.  Otherwise *tty is left alone and */
+/* the arguments should be handed to the real stty. */
+int
+exp_stty_args(tty,argv)
+exp_tty *tty;
+char **argv;
+{
+	exp_tty new;
+	int n;
+
+	new = *tty;
+	while (*argv) {
+		if (!(n = exp_stty_arg(&new,argv))) return FALSE;
+		argv += n;
+	}
+	*tty = new;
+	return TRUE;
+}
@@ -50,6 +50,7 @@ extern char *TclGetRegError();
 #else
 #include <stdlib.h>
 #endif
+#include <string.h>
 
 #ifdef HAVE_SYSMACROS_H
 #include <sys/sysmacros.h>
@@ -252,11 +253,108 @@ char *name;		/* name of pty */
 	signal(SIGCHLD, old);	/* restore signal handler */
 }
 
+/* apply stty args to the pty directly, if they are all ones we */
+/* understand; returns FALSE if /bin/stty is needed after all */
+static int
+pty_stty_native(fd,s)
+int fd;
+char *s;	/* args to stty */
+{
+#define MAX_NATIVE_ARGS 100
+	char *argv[MAX_NATIVE_ARGS+1];
+	char *buf;
+	char *p;
+	int argc = 0;
+	int ok = FALSE;
+	exp_tty tty;
+
+	/* quoting is rare enough to leave to the shell */
+	if (strpbrk(s,"\"'\\")) return FALSE;
+
+	if (!(buf = malloc(strlen(s)+1))) return FALSE;
+	strcpy(buf,s);
+	for (p = strtok(buf," \t\n");p;p = strtok((char *)0," \t\n")) {
+		if (argc == MAX_NATIVE_ARGS) goto done;
+		argv[argc++] = p;
+	}
+	argv[argc] = 0;
+
+#ifdef HAVE_TCSETATTR
+	if (-1 == tcgetattr(fd, &tty)) goto done;
+#else
+	if (-1 == ioctl(fd, TCGETS, (char *)&tty)) goto done;
+#endif
+	if (!exp_stty_args(&tty,argv)) goto done;
+#ifdef HAVE_TCSETATTR
+	ok = (-1 != tcsetattr(fd, TCSADRAIN, &tty));
+#else
+	ok = (-1 != ioctl(fd, TCSETS, (char *)&tty));
+#endif
+ done:
+	free(buf);
+	return ok;
+}
+
 int exp_dev_tty;	/* file descriptor to /dev/tty or -1 if none */
 static int knew_dev_tty;/* true if we had our hands on /dev/tty at any time */
 
 exp_tty exp_tty_original;
 
+#ifdef HAVE_TCSETATTR
+/* When the slave is set up in this process rather than in the child */
+/* (exp_getptypair), the modes stty leaves behind are remembered so */
+/* that later ptys set up the same way are spared running stty again. */
+/* stty can also change the window size, so such args aren't cached. */
+static struct {
+	int valid;
+	int ttycopy;
+	int ttyinit;
+	char *stty;		/* stty args, or 0 */
+	exp_tty current;	/* exp_tty_current at the time */
+	exp_tty result;		/* what the slave was left with */
+} tty_cache;
+
+static int
+tty_cache_ok(ttycopy,ttyinit,s)
+int ttycopy;
+int ttyinit;
+char *s;
+{
+	if (!tty_cache.valid) return FALSE;
+	if (tty_cache.ttycopy != ttycopy || tty_cache.ttyinit != ttyinit)
+		return FALSE;
+	if ((tty_cache.stty == 0) != (s == 0)) return FALSE;
+	if (s && strcmp(tty_cache.stty,s)) return FALSE;
+	if (ttycopy && knew_dev_tty &&
+	    memcmp((char *)&tty_cache.current,(char *)&exp_tty_current,
+		   sizeof(exp_tty))) return FALSE;
+	return TRUE;
+}
+
+static void
+tty_cache_save(fd,ttycopy,ttyinit,s)
+int fd;
+int ttycopy;
+int ttyinit;
+char *s;
+{
+	tty_cache.valid = FALSE;
+	if (s && (strstr(s,"rows") || strstr(s,"col"))) return;
+	if (-1 == tcgetattr(fd,&tty_cache.result)) return;
+
+	if (tty_cache.stty) free(tty_cache.stty);
+	tty_cache.stty = 0;
+	if (s) {
+		if (!(tty_cache.stty = malloc(strlen(s)+1))) return;
+		strcpy(tty_cache.stty,s);
+	}
+	tty_cache.ttycopy = ttycopy;
+	tty_cache.ttyinit = ttyinit;
+	tty_cache.current = exp_tty_current;
+	tty_cache.valid = TRUE;
+}
+#endif /* HAVE_TCSETATTR */
+
 #define GET_TTYTYPE	0
 #define SET_TTYTYPE	1
 static void
@@ -279,6 +377,13 @@ char *s;	/* stty args */
 		}
 		exp_window_size_get(fd);
 	} else {	/* type == SET_TTYTYPE */
+#ifdef HAVE_TCSETATTR
+		if (tty_cache_ok(ttycopy,ttyinit,s)) {
+			(void) tcsetattr(fd, TCSADRAIN, &tty_cache.result);
+			if (ttycopy && knew_dev_tty) exp_window_size_set(fd);
+			return;
+		}
+#endif
 		if (ttycopy && knew_dev_tty) {
 #ifdef HAVE_TCSETATTR
 			(void) tcsetattr(fd, TCSADRAIN, &exp_tty_current);
@@ -302,7 +407,8 @@ char *s;	/* stty args */
 /* diagnostics to parent stderr, since stderr has is now child's */
 /* Maybe someday they will fix stty? */
 /*			debuglog("getptyslave: (default) stty %s\n",DFLT_STTY);*/
-			pty_stty(DFLT_STTY,slave_name);
+			if (!pty_stty_native(fd,DFLT_STTY))
+				pty_stty(DFLT_STTY,slave_name);
 		}
 #endif
 
@@ -310,8 +416,12 @@ char *s;	/* stty args */
 		if (s) {
 			/* give user a chance to override any terminal parms */
 /*			debuglog("getptyslave: (user-requested) stty %s\n",s);*/
-			pty_stty(s,slave_name);
+			if (!pty_stty_native(fd,s))
+				pty_stty(s,slave_name);
 		}
+#ifdef HAVE_TCSETATTR
+		tty_cache_save(fd,ttycopy,ttyinit,s);
+#endif
 	}
 }
 
@@ -591,13 +701,11 @@ int control;	/* if 1, enable pty trapping of close/open/ioctl */
 #endif /* HAVE_PTYTRAP */
 }
 
-int
-getptyslave(ttycopy,ttyinit,stty_args)
-int ttycopy;
-int ttyinit;
-char *stty_args;
+/* open the slave side of the pty last allocated by getptymaster */
+static int
+openptyslave()
 {
-	int slave, slave2;
+	int slave;
 	char buf[10240];
 
 	if (0 > (slave = open(slave_name, O_RDWR))) return(-1);
@@ -620,6 +728,18 @@ char *stty_args;
 	}
 #endif
 #endif
+	return(slave);
+}
+
+int
+getptyslave(ttycopy,ttyinit,stty_args)
+int ttycopy;
+int ttyinit;
+char *stty_args;
+{
+	int slave, slave2;
+
+	if (0 > (slave = openptyslave())) return(-1);
 
 	if (0 == slave) {
 		/* if opened in a new process, slave will be 0 (and */
@@ -645,6 +765,94 @@ char *stty_args;
 	return(slave);
 }
 
+/*
+ * spawn -fast takes ptys from a small pool, refilled (by the caller,
+ * whenever it likes) with exp_pty_pool_fill, so that allocating them
+ * is out of the way of the spawn itself.  The slave is opened ahead of
+ * time as well.  With /dev/ptmx, allocation is the open followed by
+ * grantpt and unlockpt; elsewhere there is no pool.
+ */
+#ifdef HAVE_PTMX
+#define PTY_POOL	4
+#else
+#define PTY_POOL	0
+#endif
+
+#if PTY_POOL
+static struct {
+	int master;
+	int slave;
+	char name[64];
+} pty_pool[PTY_POOL];
+static int pty_pool_count = 0;
+static char pty_pair_name[64];	/* slave_name of the last pair handed out */
+#endif
+
+/* returns TRUE if the pool needs filling */
+int
+exp_pty_pool_fill()
+{
+#if PTY_POOL
+	while (pty_pool_count < PTY_POOL) {
+		int master, slave;
+
+		if (0 > (master = getptymaster())) break;
+		if (strlen(slave_name) >= sizeof(pty_pool[0].name)
+		    || 0 > (slave = openptyslave())) {
+			close(master);
+			break;
+		}
+		(void) fcntl(master,F_SETFD,1);
+		(void) fcntl(slave,F_SETFD,1);
+		pty_pool[pty_pool_count].master = master;
+		pty_pool[pty_pool_count].slave = slave;
+		strcpy(pty_pool[pty_pool_count].name,slave_name);
+		pty_pool_count++;
+	}
+	return(pty_pool_count < PTY_POOL);
+#else
+	return(FALSE);
+#endif
+}
+
+/* like getptymaster followed by getptyslave, except that both sides */
+/* are opened in this process, ready to be handed to a child */
+/* returns master, or -1 with *slavep untouched */
+int
+exp_getptypair(slavep,ttycopy,ttyinit,stty_args)
+int *slavep;
+int ttycopy;
+int ttyinit;
+char *stty_args;
+{
+	int master, slave;
+
+#if PTY_POOL
+	if (pty_pool_count > 0) {
+		pty_pool_count--;
+		master = pty_pool[pty_pool_count].master;
+		slave = pty_pool[pty_pool_count].slave;
+		strcpy(pty_pair_name,pty_pool[pty_pool_count].name);
+		slave_name = pty_pair_name;
+		exp_pty_slave_name = slave_name;
+		exp_pty_error = 0;
+	} else
+#endif
+	{
+		if (0 > (master = getptymaster())) return(-1);
+		if (0 > (slave = openptyslave())) {
+			close(master);
+			return(-1);
+		}
+	}
+
+	ttytype(SET_TTYTYPE,slave,ttycopy,ttyinit,stty_args);
+	(void) exp_pty_unlock();
+
+	*slavep = slave;
+	return(master);
+}
+
 #ifdef HAVE_PTYTRAP
 #include <sys/ptyio.h>
 #include <sys/time.h>
@@ -417,3 +417,31 @@ resetptyutmp()
         (void) endutent();
         return(0);
 }
+
+/* no pool of ptys here, so the caller has no reason to fill it */
+int
+exp_pty_pool_fill()
+{
+	return(0);
+}
+
+/* like getptymaster followed by getptyslave, except that both sides */
+/* are opened in this process, ready to be handed to a child */
+/* returns master, or -1 with *slavep untouched */
+int
+exp_getptypair(slavep,ttycopy,ttyinit,stty_args)
+int *slavep;
+int ttycopy;
+int ttyinit;
+char *stty_args;
+{
+	int master, slave;
+
+	if (0 > (master = getptymaster())) return(-1);
+	if (0 > (slave = getptyslave(ttycopy,ttyinit,stty_args))) {
+		close(master);
+		return(-1);
+	}
+	*slavep = slave;
+	return(master);
+}
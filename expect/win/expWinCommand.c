@@ -35,6 +35,8 @@
 
 static void ExpSockAcceptProc _ANSI_ARGS_((ClientData callbackData,
         Tcl_Channel chan, char *address, int port));
+static int ExpSpawnProgram _ANSI_ARGS_((Tcl_Interp *interp, char *argv0,
+	int echo, int usePipes, int useSocket, int argc, char **argv));
 
 /*
  *----------------------------------------------------------------------
@@ -128,7 +130,7 @@ exp_getpidproc()
 /*
  *----------------------------------------------------------------------
  *
- * Exp_SpawnCmd --
+ * Exp_SpawnObjCmd --
  *
  *	Creates a new expect process id.  It normally does this
  *	by creating a new process, but it may choose to open a
@@ -163,114 +165,115 @@ exp_getpidproc()
  *	of stuff popping up.
  *----------------------------------------------------------------------
  */
-/* arguments are passed verbatim to execvp() */
 /*ARGSUSED*/
-
 int
-Exp_SpawnCmd(ClientData clientData,Tcl_Interp *interp,int argc,char **argv)
+Exp_SpawnObjCmd(clientData, interp, objc, objv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int objc;
+    Tcl_Obj *CONST objv[];
 {
-    HANDLE hSlaveDrv = NULL;	/* Handle to communicate with slave driver */
-    Tcl_Pid slaveDrvPid;	/* Process id of the slave */
-    BOOL bRet;
-    DWORD dwRet;
-    DWORD count;
     int echo = TRUE;
-    char **a;
-    char *argv0 = argv[0];
-    char slaveName[50];		/* Used to set 'spawn_out(slave,name)' */
-    static int slaveId = 1;	/* Start at one because console0 is expect's */
-    UCHAR buf[8];		/* enough space for child status info */
-    char execPath[MAX_PATH];
-    char slavePath[MAX_PATH];
-    char imagePath[MAX_PATH];
-    struct exp_f *f;
-    HANDLE hEvent = NULL;
-    OVERLAPPED over;
-    DWORD globalPid;
-    Tcl_Channel channel = NULL;
-    Tcl_Channel channel2 = NULL;
-    Tcl_Channel spawnChan = NULL;
-    TclFile masterRFile;
-    TclFile masterWFile;
+    char *argv0 = Tcl_GetStringFromObj(objv[0],(int *)NULL);
     char *openarg = NULL;
     int leaveopen = 0;
-    char *val;
-    int hide;
-    int debug;
-    char **nargv = NULL;
-    int i, j;
     int usePipes = 0;
     int useSocket = 0;
-
-    char pipeName[100];
-    static int pipeNameId = 0;
-    char sockPort[10];
-    static int sockPortInc = 0;
-
-    /*
-     * Need to create a structure with hEvent, overlapped, etc
-     * for each pipe we handle
-     */
-
-    argc--; argv++;
-
-    for (;argc>0;argc--,argv++) {
-	if (streq(*argv,"-nottyinit")) {
+    int tcp = FALSE;		/* connect rather than run a program */
+    int telnet = FALSE;
+    char **argv;
+    int argc;
+    int i, index, rc;
+
+    static char *flags[] = {
+	"-nottyinit", "-nottycopy", "-noecho", "-console", "-pty",
+	"-open", "-leaveopen", "-ignore", "-pipes", "-socket", "-fast",
+	"-tcp", "-telnet", (char *) NULL
+    };
+    enum flags {
+	SPAWN_NOTTYINIT, SPAWN_NOTTYCOPY, SPAWN_NOECHO, SPAWN_CONSOLE,
+	SPAWN_PTY, SPAWN_OPEN, SPAWN_LEAVEOPEN, SPAWN_IGNORE, SPAWN_PIPES,
+	SPAWN_SOCKET, SPAWN_FAST, SPAWN_TCP, SPAWN_TELNET
+    };
+
+    for (i = 1;i<objc;i++) {
+	/* the first word not starting with "-" names the program */
+	if (Tcl_GetStringFromObj(objv[i],(int *)NULL)[0] != '-') break;
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case SPAWN_NOTTYINIT:
 	    exp_error(interp, "%s -nottyinit is unsupported on NT", argv0);
 	    return TCL_ERROR;
-	} else if (streq(*argv,"-nottycopy")) {
+	case SPAWN_NOTTYCOPY:
 	    exp_error(interp, "%s -nottycopy is unsupported on NT", argv0);
 	    return TCL_ERROR;
-	} else if (streq(*argv,"-noecho")) {
+	case SPAWN_NOECHO:
 	    echo = FALSE;
-	} else if (streq(*argv,"-console")) {
+	    break;
+	case SPAWN_CONSOLE:
 	    exp_error(interp, "%s -console is unsupported on NT", argv0);
 	    return TCL_ERROR;
-	} else if (streq(*argv,"-pty")) {
+	case SPAWN_PTY:
 	    exp_error(interp, "%s -pty is unsupported on NT", argv0);
 	    return TCL_ERROR;
-	} else if (streq(*argv,"-open")) {
+	case SPAWN_OPEN:
 	    /*
 	     * This allows us to treat an open file id as an
 	     * expect process id.  We should be eventually be able
 	     * to support this under NT.
 	     */
-	    if (argc < 2) {
+	    if (i+1 >= objc) {
 		exp_error(interp,"usage: %s -open file-identifier", argv0);
 		return TCL_ERROR;
 	    }
-	    openarg = argv[1];
-	    argc--; argv++;
-	} else if (streq(*argv,"-leaveopen")) {
+	    openarg = Tcl_GetStringFromObj(objv[++i],(int *)NULL);
+	    break;
+	case SPAWN_LEAVEOPEN:
 	    /*
 	     * This leaves the file id open when the process id
 	     * gets closed.  We should be able to eventually support
 	     * this under NT.
 	     */
-	    if (argc < 2) {
+	    if (i+1 >= objc) {
 		exp_error(interp,"usage: %s -leaveopen file-identifier", argv0);
 		return TCL_ERROR;
 	    }
-	    openarg = argv[1];
+	    openarg = Tcl_GetStringFromObj(objv[++i],(int *)NULL);
 	    leaveopen = TRUE;
-	    argc--; argv++;
-	} else if (streq(*argv,"-ignore")) {
-	    if (argc < 2) {
+	    break;
+	case SPAWN_IGNORE:
+	    if (i+1 >= objc) {
 		exp_error(interp,"usage: %s -ignore signal", argv0);
 		return TCL_ERROR;
 	    }
-	    argc--; argv++;
 	    exp_error(interp, "%s -ignore is unsupported on NT", argv0);
 	    return TCL_ERROR;
-	} else if (streq(*argv,"-pipes")) {
+	case SPAWN_PIPES:
 	    usePipes = 1;
-	} else if (streq(*argv,"-socket")) {
+	    break;
+	case SPAWN_SOCKET:
 	    useSocket = 1;
-	} else break;
+	    break;
+	case SPAWN_FAST:
+	    /* there is no pty setup to speed up on NT */
+	    break;
+	case SPAWN_TCP:
+	    tcp = TRUE;
+	    break;
+	case SPAWN_TELNET:
+	    tcp = TRUE;
+	    telnet = TRUE;
+	    break;
+	}
     }
+    objc -= i;
+    objv += i;
 
     if (openarg) {
-	if (argc != 0) {
+	if (objc != 0) {
 	    exp_error(interp,"usage: -[leave]open [fileXX]");
 	    return TCL_ERROR;
 	}
@@ -279,12 +282,140 @@ Exp_SpawnCmd(ClientData clientData,Tcl_Interp *interp,int argc,char **argv)
 	return ExpSpawnOpen(interp, openarg, leaveopen);
     }
 
-    if (!openarg && (argc == 0)) {
+    if (tcp) {
+	char *host, *port;
+
+	/* the telnet port is the default for -telnet */
+	if (objc < 1 || objc > 2 || (objc == 1 && !telnet)) {
+	    exp_error(interp,"usage: %s -tcp host port or -telnet host [port]",
+		      argv0);
+	    return TCL_ERROR;
+	}
+	host = Tcl_GetStringFromObj(objv[0],(int *)NULL);
+	port = (objc == 2) ? Tcl_GetStringFromObj(objv[1],(int *)NULL) : "23";
+	if (echo) exp_log(0,"%s %s %s\r\n",argv0,host,port);
+	return ExpSpawnTcp(interp, host, port, telnet);
+    }
+
+    if (objc == 0) {
 	exp_error(interp,"usage: %s [spawn-args] program [program-args]",
 		  argv0);
 	return(TCL_ERROR);
     }
 
+    /* the program and its arguments are passed on as plain strings */
+    argc = objc;
+    argv = (char **) ckalloc(sizeof(char *) * (argc+1));
+    for (i = 0;i<argc;i++) {
+	argv[i] = Tcl_GetStringFromObj(objv[i],(int *)NULL);
+    }
+    argv[argc] = (char *) NULL;
+
+    rc = ExpSpawnProgram(interp, argv0, echo, usePipes, useSocket,
+			 argc, argv);
+    ckfree((char *) argv);
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_SpawnCmd --
+ *
+ *	String interface to Exp_SpawnObjCmd, kept for the C library
+ *	which builds a spawn argv directly.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Exp_SpawnCmd(clientData, interp, argc, argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    char **argv;
+{
+    Tcl_Obj **objv;
+    int i, rc;
+
+    objv = (Tcl_Obj **) ckalloc(sizeof(Tcl_Obj *) * argc);
+    for (i = 0;i<argc;i++) {
+	objv[i] = Tcl_NewStringObj(argv[i], -1);
+	Tcl_IncrRefCount(objv[i]);
+    }
+    rc = Exp_SpawnObjCmd(clientData, interp, argc, objv);
+    for (i = 0;i<argc;i++) {
+	Tcl_DecrRefCount(objv[i]);
+    }
+    ckfree((char *) objv);
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpSpawnProgram --
+ *
+ *	Runs argv[0] under a slave driver and makes it the current
+ *	spawn id.  argv is NULL terminated and holds the program and
+ *	its arguments, the spawn flags having already been parsed
+ *	by Exp_SpawnObjCmd.
+ *
+ * Results:
+ *	A standard Tcl result
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpSpawnProgram(interp, argv0, echo, usePipes, useSocket, argc, argv)
+    Tcl_Interp *interp;
+    char *argv0;
+    int echo;
+    int usePipes;
+    int useSocket;
+    int argc;
+    char **argv;
+{
+    HANDLE hSlaveDrv = NULL;	/* Handle to communicate with slave driver */
+    Tcl_Pid slaveDrvPid;	/* Process id of the slave */
+    BOOL bRet;
+    DWORD dwRet;
+    DWORD count;
+    char **a;
+    char slaveName[50];		/* Used to set 'spawn_out(slave,name)' */
+    static int slaveId = 1;	/* Start at one because console0 is expect's */
+    UCHAR buf[8];		/* enough space for child status info */
+    char execPath[MAX_PATH];
+    char slavePath[MAX_PATH];
+    char imagePath[MAX_PATH];
+    struct exp_f *f;
+    HANDLE hEvent = NULL;
+    OVERLAPPED over;
+    DWORD globalPid;
+    Tcl_Channel channel = NULL;
+    Tcl_Channel channel2 = NULL;
+    Tcl_Channel spawnChan = NULL;
+    TclFile masterRFile;
+    TclFile masterWFile;
+    char *val;
+    int hide;
+    int debug;
+    char **nargv = NULL;
+    int i, j;
+
+    char pipeName[100];
+    static int pipeNameId = 0;
+    char sockPort[10];
+    static int sockPortInc = 0;
+
+    /*
+     * Need to create a structure with hEvent, overlapped, etc
+     * for each pipe we handle
+     */
 
     Tcl_ReapDetachedProcs();
 
@@ -28,7 +28,9 @@
  *	Amount written or -1 with errorcode in errorPtr
  *    
  * Side Effects:
- *	None. 
+ *	Each write is framed for the slave driver with a length header.
+ *	Until the rest of a partly written frame has gone out, no more
+ *	than that rest is written.
  *
  *----------------------------------------------------------------------
  */
@@ -61,6 +63,8 @@ ExpPlatformSpawnOutput(instanceData, bufPtr, toWrite, errorPtr)
 	    return 0;
 	}
 	ssPtr->toWrite = toWrite;
+    } else if (toWrite > ssPtr->toWrite) {
+	toWrite = ssPtr->toWrite;
     }
 
     n = (Tcl_GetChannelType(channelPtr)->outputProc)
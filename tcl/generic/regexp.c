@@ -750,6 +750,10 @@ static int 		regmatch _ANSI_ARGS_((char *prog,
 			    struct regexec_state *restate));
 static int 		regrepeat _ANSI_ARGS_((char *p,
 			    struct regexec_state *restate));
+static int		regloops _ANSI_ARGS_((regexp *prog, int *sizep,
+			    int *nsubp));
+static int		regpike _ANSI_ARGS_((regexp *prog, char *string,
+			    char *start, int size, int nsub));
 
 #ifdef DEBUG
 int regnarrate = 0;
@@ -769,6 +773,7 @@ char *start;
 	register char *s;
 	struct regexec_state state;
 	struct regexec_state *restate= &state;
+	int size, nsub;
 
 	/* Be paranoid... */
 	if (prog == NULL || string == NULL) {
@@ -798,6 +803,10 @@ char *start;
 	/* Mark beginning of line for ^ . */
 	restate->regbol = start;
 
+	/* Loops can make regmatch take exponential time; avoid it. */
+	if (regloops(prog, &size, &nsub))
+		return(regpike(prog, string, start, size, nsub));
+
 	/* Simplest case:  anchored match need be tried only once. */
 	if (prog->reganch)
 		return(regtry(prog, string, restate));
@@ -853,6 +862,345 @@ struct regexec_state *restate;
 		return(0);
 }
 
+/*
+ - regpike - try all starting points at once, in time linear in the string
+ *
+ * regmatch backtracks, so on patterns with loops it can take time
+ * exponential in the length of the string ("(a|aa)*b" against a long run
+ * of a's is the classic).  Programs containing loops are run here
+ * instead, as a nondeterministic machine that carries every way the match
+ * could be going along the string at once (Thompson's construction, with
+ * Pike's addition of per-thread subexpression pointers).  Threads are kept
+ * in the order regmatch would have tried them and a thread reaching a node
+ * already reached at the same point in the string by an earlier one is
+ * dropped, since it can only do what the earlier one does.  The first
+ * match regmatch would have found is found, with the same startp/endp,
+ * after looking at each char of the string once per node.
+ */
+
+/*
+ * A thread is at a node that eats a character, or at END.  For an EXACTLY
+ * node, opnd points at the next char of the operand to match; for a PLUS,
+ * it is non-NULL once the operand has been matched at least once.
+ */
+typedef struct regthread {
+	char *node;
+	char *opnd;
+	char *start;		/* where this thread's match began */
+	char **sub;		/* startp[1..nsub], then endp[1..nsub] */
+} regthread;
+
+struct regpike_state {
+	char *program;
+	char *regbol;		/* Beginning of input, for ^ check. */
+	int nsub;		/* Highest () number used in the program. */
+	int *mark;		/* mark[offset] == stamp if that state */
+	int stamp;		/* is already in the list being built. */
+	regthread *list;	/* Threads of the list being built ... */
+	int count;		/* ... and how many there are. */
+};
+
+static void		regpikeadd _ANSI_ARGS_((struct regpike_state *ps,
+			    char *scan, char *start, char **sub,
+			    char *input));
+static void		regpikethread _ANSI_ARGS_((struct regpike_state *ps,
+			    char *node, char *opnd, char *start, char **sub));
+static int		regpikesimple _ANSI_ARGS_((char *p, int c));
+
+/*
+ - regloops - does a program have loops?  Also report its size and how
+ * many () it uses.
+ */
+static int
+regloops(prog, sizep, nsubp)
+regexp *prog;
+int *sizep;
+int *nsubp;
+{
+	register char *scan;
+	int loops = 0;
+
+	*nsubp = 0;
+	for (scan = prog->program + 1; OP(scan) != END; scan += 3) {
+		switch (OP(scan)) {
+		case STAR:
+		case PLUS:
+		case BACK:
+			loops = 1;
+			break;
+		case EXACTLY:
+		case ANYOF:
+		case ANYBUT:
+			scan += strlen(OPERAND(scan)) + 1;
+			break;
+		default:
+			if (OP(scan) > OPEN && OP(scan) < OPEN+NSUBEXP
+					&& OP(scan) - OPEN > *nsubp)
+				*nsubp = OP(scan) - OPEN;
+			break;
+		}
+	}
+	*sizep = scan + 3 - prog->program;
+	return(loops);
+}
+
+static int
+regpike(prog, string, start, size, nsub)
+regexp *prog;
+char *string;
+char *start;		/* Beginning of input, for ^ check. */
+int size;		/* As reported by regloops. */
+int nsub;
+{
+	struct regpike_state state;
+	struct regpike_state *ps = &state;
+	regthread *clist, *nlist, *t;
+	int ccount;
+	char **subs;		/* storage for the threads' sub pointers */
+	char **sub;
+	char *s;
+	int i, found = 0;
+
+	ps->program = prog->program;
+	ps->regbol = start;
+	ps->nsub = nsub;
+	ps->mark = (int *) ckalloc((unsigned) (size * sizeof(int)));
+	clist = (regthread *) ckalloc((unsigned) (2 * size * sizeof(regthread)));
+	nlist = clist + size;
+	subs = (char **) ckalloc((unsigned) (((2 * size + 1) * 2 * nsub + 1)
+			* sizeof(char *)));
+	for (i = 0; i < 2 * size; i++)
+		clist[i].sub = subs + i * 2 * nsub;
+	sub = subs + 2 * size * 2 * nsub;
+	for (i = 0; i < size; i++)
+		ps->mark[i] = 0;
+	for (i = 0; i < NSUBEXP; i++) {
+		prog->startp[i] = NULL;
+		prog->endp[i] = NULL;
+	}
+
+	ps->stamp = 1;
+	ps->list = clist;
+	ps->count = 0;
+	for (s = string; ; s++) {
+		/* Begin a new match here, unless an earlier one succeeded. */
+		if (!found && (!prog->reganch || s == string)
+				&& (prog->regstart == '\0' || *s == prog->regstart)) {
+			for (i = 0; i < 2 * nsub; i++)
+				sub[i] = NULL;
+			regpikeadd(ps, prog->program + 1, s, sub, s);
+		}
+		ccount = ps->count;
+		if (ccount == 0) {
+			if (found || prog->reganch || *s == '\0')
+				break;
+			ps->stamp++;
+			if (prog->regstart != '\0') {
+				/* Nothing can happen before the next regstart. */
+				s = strchr(s + 1, prog->regstart);
+				if (s == NULL)
+					break;
+				s--;
+			}
+			continue;
+		}
+
+		/* Step every thread over *s, in priority order. */
+		ps->stamp++;
+		ps->list = nlist;
+		ps->count = 0;
+		for (t = clist; t < clist + ccount; t++) {
+			char *next = regnext(t->node);
+
+			if (OP(t->node) == END) {
+				/* Lower-priority threads can't win any more. */
+				prog->startp[0] = t->start;
+				prog->endp[0] = s;
+				for (i = 1; i <= nsub; i++) {
+					prog->startp[i] = t->sub[i-1];
+					prog->endp[i] = t->sub[nsub+i-1];
+				}
+				found = 1;
+				break;
+			}
+			if (*s == '\0')
+				continue;
+			switch (OP(t->node)) {
+			case ANY:
+				regpikeadd(ps, next, t->start, t->sub, s+1);
+				break;
+			case ANYOF:
+				if (strchr(OPERAND(t->node), *s) != NULL)
+					regpikeadd(ps, next, t->start, t->sub, s+1);
+				break;
+			case ANYBUT:
+				if (strchr(OPERAND(t->node), *s) == NULL)
+					regpikeadd(ps, next, t->start, t->sub, s+1);
+				break;
+			case EXACTLY:
+				if (*t->opnd != *s)
+					break;
+				if (t->opnd[1] == '\0') {
+					regpikeadd(ps, next, t->start, t->sub, s+1);
+				} else if (ps->mark[t->opnd+1 - ps->program]
+						!= ps->stamp) {
+					ps->mark[t->opnd+1 - ps->program] = ps->stamp;
+					regpikethread(ps, t->node, t->opnd+1,
+						t->start, t->sub);
+				}
+				break;
+			case STAR:
+				if (regpikesimple(OPERAND(t->node), *s))
+					regpikeadd(ps, t->node, t->start, t->sub, s+1);
+				break;
+			case PLUS:
+				if (!regpikesimple(OPERAND(t->node), *s))
+					break;
+				/* Matched once: from here on it's like STAR. */
+				if (ps->mark[OPERAND(t->node) - ps->program]
+						!= ps->stamp) {
+					ps->mark[OPERAND(t->node) - ps->program]
+						= ps->stamp;
+					regpikethread(ps, t->node, OPERAND(t->node),
+						t->start, t->sub);
+					regpikeadd(ps, next, t->start, t->sub, s+1);
+				}
+				break;
+			}
+		}
+		if (*s == '\0')
+			break;
+		t = clist;
+		clist = nlist;
+		nlist = t;
+	}
+
+	ckfree((char *) ps->mark);
+	ckfree((char *) (clist < nlist ? clist : nlist));
+	ckfree((char *) subs);
+	return(found);
+}
+
+/*
+ - regpikeadd - add the threads that follow from reaching a node
+ *
+ * Follows everything that doesn't eat a character, adding a thread at
+ * each node that does, in the order regmatch would try them.
+ */
+static void
+regpikeadd(ps, scan, start, sub, input)
+struct regpike_state *ps;
+char *scan;
+char *start;
+char **sub;		/* updated in place across OPEN and CLOSE */
+char *input;		/* where in the string this happens */
+{
+	register int no;
+	char *save;
+
+	while (scan != NULL) {
+		if (ps->mark[scan - ps->program] == ps->stamp)
+			return;
+		ps->mark[scan - ps->program] = ps->stamp;
+
+		switch (OP(scan)) {
+		case BOL:
+			if (input != ps->regbol)
+				return;
+			break;
+		case EOL:
+			if (*input != '\0')
+				return;
+			break;
+		case NOTHING:
+		case BACK:
+			break;
+		case BRANCH:
+			if (OP(regnext(scan)) != BRANCH) {	/* No choice. */
+				scan = OPERAND(scan);
+				continue;
+			}
+			do {
+				regpikeadd(ps, OPERAND(scan), start, sub, input);
+				scan = regnext(scan);
+			} while (scan != NULL && OP(scan) == BRANCH);
+			return;
+		case STAR:
+			/* Another one is preferred to moving on. */
+			regpikethread(ps, scan, NULL, start, sub);
+			break;
+		case EXACTLY:
+			regpikethread(ps, scan, OPERAND(scan), start, sub);
+			return;
+		case PLUS:
+		case ANY:
+		case ANYOF:
+		case ANYBUT:
+		case END:
+			regpikethread(ps, scan, NULL, start, sub);
+			return;
+		default:
+			if (OP(scan) > OPEN && OP(scan) < OPEN+NSUBEXP) {
+				/* Later invocations overwrite earlier ones. */
+				no = OP(scan) - OPEN - 1;
+			} else if (OP(scan) > CLOSE && OP(scan) < CLOSE+NSUBEXP) {
+				no = ps->nsub + OP(scan) - CLOSE - 1;
+			} else {
+				TclRegError("memory corruption");
+				return;
+			}
+			save = sub[no];
+			sub[no] = input;
+			regpikeadd(ps, regnext(scan), start, sub, input);
+			sub[no] = save;
+			return;
+		}
+		scan = regnext(scan);
+	}
+}
+
+/*
+ - regpikethread - append a thread to the list being built
+ */
+static void
+regpikethread(ps, node, opnd, start, sub)
+struct regpike_state *ps;
+char *node;
+char *opnd;
+char *start;
+char **sub;
+{
+	register regthread *t = &ps->list[ps->count++];
+	register int i;
+
+	t->node = node;
+	t->opnd = opnd;
+	t->start = start;
+	for (i = 0; i < 2 * ps->nsub; i++)
+		t->sub[i] = sub[i];
+}
+
+/*
+ - regpikesimple - does the operand of a STAR or PLUS match c?
+ */
+static int
+regpikesimple(p, c)
+char *p;
+int c;
+{
+	switch (OP(p)) {
+	case ANY:
+		return(c != '\0');
+	case EXACTLY:
+		return(*OPERAND(p) == c);
+	case ANYOF:
+		return(c != '\0' && strchr(OPERAND(p), c) != NULL);
+	case ANYBUT:
+		return(c != '\0' && strchr(OPERAND(p), c) == NULL);
+	}
+	return(0);
+}
+
 /*
  - regmatch - main matching routine
  *